@@ -0,0 +1,510 @@
+// Front-end micro-benchmark: generates synthetic Gran corpora and measures
+// Lexer::scanTokens, Parser::parse and parseParallel, flattening and freeing
+// the AST, streamed lexing plus parsing (eager and with function bodies
+// deferred), and loading the AST from the cache. Results are printed as
+// one JSON object per line so runs can be collected and compared across
+// commits.
+//
+//   bench_frontend [--size MB] [--iterations N] [--threads N] [--corpus NAME] [--label TEXT]
+//   bench_frontend --dump NAME [--size MB]     (writes a corpus to stdout)
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <new>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "../include/ast_cache.h"
+#include "../include/flat_ast.h"
+#include "../include/lexer.h"
+#include "../include/parser.h"
+#include "../include/simd_scan.h"
+#include "../include/thread_pool.h"
+
+// ---- Allocation counting ----------------------------------------------------
+
+namespace {
+std::atomic<size_t> allocationCount{0};
+}
+
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+// ---- Corpus generation ------------------------------------------------------
+
+class CorpusWriter {
+public:
+    CorpusWriter(size_t targetBytes, unsigned seed) : target(targetBytes), rng(seed) {}
+
+    bool full() const { return out.size() >= target; }
+    std::string take() { return std::move(out); }
+
+    size_t pick(size_t n) { return std::uniform_int_distribution<size_t>(0, n - 1)(rng); }
+
+    std::string name(const char* prefix) { return prefix + std::to_string(pick(64)); }
+
+    std::string atom() {
+        switch (pick(4)) {
+            case 0: return std::to_string(pick(100000));
+            case 1: return std::to_string(pick(1000)) + "." + std::to_string(pick(100));
+            case 2: return pick(2) ? "true" : "false";
+            default: return name("v");
+        }
+    }
+
+    std::string expr(int depth) {
+        static const char* const ops[] = {"+", "-", "*", "/", "<", ">", "<=", ">=", "==", "!="};
+        if (depth <= 0 || pick(4) == 0) return atom();
+        switch (pick(4)) {
+            case 0: return "(" + expr(depth - 1) + ")";
+            case 1: return name("f") + "(" + expr(depth - 1) + ", " + atom() + ")";
+            default: return expr(depth - 1) + " " + ops[pick(10)] + " " + expr(depth - 1);
+        }
+    }
+
+    std::string text(size_t length) {
+        static const char letters[] = "abcdefghijklmnopqrstuvwxyz ,.!?";
+        std::string s(length, ' ');
+        for (char& c : s) c = letters[pick(sizeof(letters) - 1)];
+        return s;
+    }
+
+    void line(int indent, const std::string& code) {
+        out.append(static_cast<size_t>(indent) * 4, ' ');
+        out += code;
+        out += '\n';
+    }
+
+    void statement(int indent, int depth) {
+        switch (depth > 0 ? pick(6) : pick(3)) {
+            case 0: line(indent, "var " + name("v") + " = " + expr(3) + ";"); break;
+            case 1: line(indent, name("v") + " = " + expr(3) + ";"); break;
+            case 2: line(indent, "screenit " + expr(2) + ";"); break;
+            case 3:
+                line(indent, "if (" + expr(2) + ") {");
+                statement(indent + 1, depth - 1);
+                line(indent, "} else {");
+                statement(indent + 1, depth - 1);
+                line(indent, "}");
+                break;
+            case 4:
+                line(indent, "while (" + expr(2) + ") {");
+                statement(indent + 1, depth - 1);
+                line(indent, "}");
+                break;
+            default:
+                line(indent, "for (var i = 0; i < " + atom() + "; i = i + 1) {");
+                statement(indent + 1, depth - 1);
+                line(indent, "}");
+                break;
+        }
+    }
+
+private:
+    std::string out;
+    size_t target;
+    std::mt19937 rng;
+};
+
+// Many small functions with ordinary control flow.
+std::string functionsCorpus(size_t bytes) {
+    CorpusWriter w(bytes, 1);
+    for (size_t n = 0; !w.full(); n++) {
+        w.line(0, "func f" + std::to_string(n) + "(a, b, c) {");
+        for (size_t i = 0, count = 2 + w.pick(6); i < count; i++) w.statement(1, 2);
+        w.line(1, "return " + w.expr(2) + ";");
+        w.line(0, "}");
+    }
+    return w.take();
+}
+
+// Long, deeply nested expressions.
+std::string expressionsCorpus(size_t bytes) {
+    CorpusWriter w(bytes, 2);
+    for (size_t n = 0; !w.full(); n++) {
+        w.line(0, "var e" + std::to_string(n) + " = " + w.expr(12) + ";");
+    }
+    return w.take();
+}
+
+// Statements dominated by long string literals.
+std::string stringsCorpus(size_t bytes) {
+    CorpusWriter w(bytes, 3);
+    while (!w.full()) {
+        w.line(0, "screenit \"" + w.text(64 + w.pick(2048)) + "\";");
+    }
+    return w.take();
+}
+
+// Sparse code buried in line comments.
+std::string commentsCorpus(size_t bytes) {
+    CorpusWriter w(bytes, 4);
+    while (!w.full()) {
+        for (size_t i = 0, count = 1 + w.pick(8); i < count; i++) {
+            w.line(0, "// " + w.text(16 + w.pick(96)));
+        }
+        w.statement(0, 1);
+    }
+    return w.take();
+}
+
+// One statement nested as deep as the size allows (if, while, for and bare
+// blocks in turn) around one long right-nested expression. At the default
+// size both nest well over 100000 levels deep, which only parses and walks
+// if nothing on the way recurses per level.
+std::string nestedCorpus(size_t bytes) {
+    static const char* const openers[] = {"if (d < 1) {", "while (d > 2) {", "for (; d < 3;) {", "{"};
+    std::string out = "var d = 0;\n";
+    size_t depth = 0;
+    while (out.size() < bytes / 2) {
+        out += openers[depth++ % 4];
+        out += '\n';
+    }
+    out += "d = ";
+    size_t groups = 0;
+    while (out.size() + groups + depth < bytes) out += groups++ % 2 ? "-(d * " : "(1 + ";
+    out += "d";
+    out.append(groups, ')');
+    out += ";\n";
+    out.append(depth, '}');
+    out += '\n';
+    return out;
+}
+
+struct Corpus {
+    const char* name;
+    std::string (*generate)(size_t bytes);
+};
+
+const Corpus corpora[] = {
+    {"functions", functionsCorpus},
+    {"expressions", expressionsCorpus},
+    {"strings", stringsCorpus},
+    {"comments", commentsCorpus},
+    {"nested", nestedCorpus},
+};
+
+const Corpus& findCorpus(const std::string& name) {
+    for (const Corpus& corpus : corpora) {
+        if (name == corpus.name) return corpus;
+    }
+    throw std::runtime_error("Unknown corpus: " + name);
+}
+
+// ---- Measurement ------------------------------------------------------------
+
+// Counts AST nodes, statements and expressions alike, and keeps them for
+// the dispatch phases. Children are queued instead of visited recursively,
+// so the nested corpus counts too.
+class NodeCounter : public ExprVisitor, public StmtVisitor {
+public:
+    size_t nodes = 0;
+    std::vector<Expr*> exprs;
+    std::vector<Stmt*> stmts;
+
+    void countTree(Stmt* root) {
+        count(root);
+        while (!pending.empty()) {
+            auto [expr, stmt] = pending.back();
+            pending.pop_back();
+            if (expr) expr->accept(this);
+            else stmt->accept(this);
+        }
+    }
+
+    void count(Expr* expr) { if (expr) { nodes++; exprs.push_back(expr); pending.emplace_back(expr, nullptr); } }
+    void count(Stmt* stmt) { if (stmt) { nodes++; stmts.push_back(stmt); pending.emplace_back(nullptr, stmt); } }
+
+    void visitBinaryExpr(BinaryExpr* expr) override { count(expr->left); count(expr->right); }
+    void visitUnaryExpr(UnaryExpr* expr) override { count(expr->right); }
+    void visitLiteralExpr(LiteralExpr*) override {}
+    void visitVariableExpr(VariableExpr*) override {}
+    void visitAssignExpr(AssignExpr* expr) override { count(expr->value); }
+    void visitCallExpr(CallExpr* expr) override {
+        for (auto& argument : expr->arguments) count(argument);
+    }
+    void visitGroupingExpr(GroupingExpr* expr) override { count(expr->expression); }
+
+    void visitExpressionStmt(ExprStmt* stmt) override { count(stmt->expression); }
+    void visitPrintStmt(PrintStmt* stmt) override { count(stmt->expression); }
+    void visitVarStmt(VarStmt* stmt) override { count(stmt->initializer); }
+    void visitBlockStmt(BlockStmt* stmt) override {
+        for (auto& statement : stmt->statements) count(statement);
+    }
+    void visitIfStmt(IfStmt* stmt) override {
+        count(stmt->condition);
+        count(stmt->thenBranch);
+        count(stmt->elseBranch);
+    }
+    void visitWhileStmt(WhileStmt* stmt) override { count(stmt->condition); count(stmt->body); }
+    void visitForStmt(ForStmt* stmt) override {
+        count(stmt->initializer);
+        count(stmt->condition);
+        count(stmt->increment);
+        count(stmt->body);
+    }
+    void visitFunctionStmt(FunctionStmt* stmt) override {
+        for (auto& statement : stmt->body) count(statement);
+    }
+    void visitReturnStmt(ReturnStmt* stmt) override { count(stmt->value); }
+
+private:
+    std::vector<std::pair<Expr*, Stmt*>> pending;
+};
+
+// Classifies every node the way the passes used to, one dynamic_cast per
+// node class in the order the code generator tried them, and the way they
+// do now, with a switch on the kind tag. The sum keeps the work from being
+// optimized away.
+size_t dispatchRtti(const NodeCounter& counter) {
+    size_t sum = 0;
+    for (Stmt* stmt : counter.stmts) {
+        if (dynamic_cast<ExprStmt*>(stmt)) sum += 1;
+        else if (dynamic_cast<PrintStmt*>(stmt)) sum += 2;
+        else if (dynamic_cast<VarStmt*>(stmt)) sum += 3;
+        else if (dynamic_cast<BlockStmt*>(stmt)) sum += 4;
+        else if (dynamic_cast<IfStmt*>(stmt)) sum += 5;
+        else if (dynamic_cast<WhileStmt*>(stmt)) sum += 6;
+        else if (dynamic_cast<FunctionStmt*>(stmt)) sum += 7;
+        else if (dynamic_cast<ReturnStmt*>(stmt)) sum += 8;
+        else if (dynamic_cast<ForStmt*>(stmt)) sum += 9;
+    }
+    for (Expr* expr : counter.exprs) {
+        if (dynamic_cast<BinaryExpr*>(expr)) sum += 1;
+        else if (dynamic_cast<UnaryExpr*>(expr)) sum += 2;
+        else if (dynamic_cast<LiteralExpr*>(expr)) sum += 3;
+        else if (dynamic_cast<VariableExpr*>(expr)) sum += 4;
+        else if (dynamic_cast<CallExpr*>(expr)) sum += 5;
+        else if (dynamic_cast<GroupingExpr*>(expr)) sum += 6;
+        else if (dynamic_cast<AssignExpr*>(expr)) sum += 7;
+    }
+    return sum;
+}
+
+size_t dispatchTag(const NodeCounter& counter) {
+    size_t sum = 0;
+    for (Stmt* stmt : counter.stmts) {
+        switch (stmt->kind) {
+            case StmtKind::Expression: sum += 1; break;
+            case StmtKind::Print: sum += 2; break;
+            case StmtKind::Var: sum += 3; break;
+            case StmtKind::Block: sum += 4; break;
+            case StmtKind::If: sum += 5; break;
+            case StmtKind::While: sum += 6; break;
+            case StmtKind::Function: sum += 7; break;
+            case StmtKind::Return: sum += 8; break;
+            case StmtKind::For: sum += 9; break;
+        }
+    }
+    for (Expr* expr : counter.exprs) {
+        switch (expr->kind) {
+            case ExprKind::Binary: sum += 1; break;
+            case ExprKind::Unary: sum += 2; break;
+            case ExprKind::Literal: sum += 3; break;
+            case ExprKind::Variable: sum += 4; break;
+            case ExprKind::Call: sum += 5; break;
+            case ExprKind::Grouping: sum += 6; break;
+            case ExprKind::Assign: sum += 7; break;
+        }
+    }
+    return sum;
+}
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct Sample {
+    double seconds = 1e30;  // best of all iterations
+    size_t allocations = 0;
+};
+
+void record(Sample& sample, double seconds, size_t allocations) {
+    sample.seconds = std::min(sample.seconds, seconds);
+    sample.allocations = allocations;
+}
+
+std::string jsonString(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+void report(const char* phase, const std::string& corpus, const std::string& label,
+            size_t bytes, size_t tokens, size_t nodes, const Sample& sample) {
+    std::printf("{\"label\":%s,\"phase\":\"%s\",\"corpus\":\"%s\",\"simd\":\"%s\","
+                "\"bytes\":%zu,\"tokens\":%zu,\"nodes\":%zu,\"seconds\":%.6f,"
+                "\"mb_per_s\":%.2f,\"tokens_per_s\":%.0f,\"allocs_per_token\":%.4f,\"ns_per_node\":%.2f}\n",
+                jsonString(label).c_str(), phase, corpus.c_str(), simd_scan::implementation(),
+                bytes, tokens, nodes, sample.seconds,
+                bytes / sample.seconds / (1024.0 * 1024.0),
+                tokens / sample.seconds,
+                tokens ? static_cast<double>(sample.allocations) / tokens : 0.0,
+                nodes ? sample.seconds * 1e9 / nodes : 0.0);
+}
+
+void benchmark(const Corpus& corpus, size_t bytes, int iterations, ThreadPool& pool, const std::string& label) {
+    const std::string source = corpus.generate(bytes);
+    const std::string cacheDir = (std::filesystem::temp_directory_path() / "gran-bench-cache").string();
+    AstCache cache(cacheDir);
+    Sample lex;
+    Sample parse;
+    Sample parallelParse;
+    Sample teardown;
+    Sample flattening;
+    Sample stream;
+    Sample lazyStream;
+    Sample cacheLoad;
+    Sample rttiDispatch;
+    Sample tagDispatch;
+    size_t tokenCount = 0;
+    size_t nodeCount = 0;
+    for (int i = 0; i < iterations; i++) {
+        size_t allocations = allocationCount.load();
+        Clock::time_point start = Clock::now();
+        Lexer lexer(source);
+        std::vector<Token> tokens = lexer.scanTokens();
+        record(lex, secondsSince(start), allocationCount.load() - allocations);
+        tokenCount = tokens.size();
+
+        allocations = allocationCount.load();
+        start = Clock::now();
+        Arena arena;
+        Parser parser(tokens, source, arena);
+        std::vector<Stmt*> statements = parser.parse();
+        record(parse, secondsSince(start), allocationCount.load() - allocations);
+
+        {
+            Arena parallelArena;
+            start = Clock::now();
+            std::vector<Stmt*> parallel = Parser::parseParallel(tokens, source, parallelArena, pool);
+            record(parallelParse, secondsSince(start), 0);
+        }
+
+        NodeCounter counter;
+        for (auto& statement : statements) counter.countTree(statement);
+        nodeCount = counter.nodes;
+
+        start = Clock::now();
+        size_t rttiSum = dispatchRtti(counter);
+        record(rttiDispatch, secondsSince(start), 0);
+        start = Clock::now();
+        size_t tagSum = dispatchTag(counter);
+        record(tagDispatch, secondsSince(start), 0);
+        if (rttiSum != tagSum) throw std::runtime_error("dispatch phases disagree on node kinds");
+
+        start = Clock::now();
+        FlatAst flat = flatten(statements);
+        record(flattening, secondsSince(start), 0);
+
+        start = Clock::now();
+        statements.clear();
+        arena.reset();
+        record(teardown, secondsSince(start), 0);
+        // Lexing and parsing interleaved, as the compiler driver runs them.
+        allocations = allocationCount.load();
+        start = Clock::now();
+        Lexer streamLexer(source);
+        Parser streamParser(streamLexer, source, arena);
+        statements = streamParser.parse();
+        record(stream, secondsSince(start), allocationCount.load() - allocations);
+
+        // A repeat run on the same source: hash, map the entry, rebuild the tree.
+        if (i == 0) cache.store(source, statements);
+        arena.reset();
+        allocations = allocationCount.load();
+        start = Clock::now();
+        std::optional<std::vector<Stmt*>> cached = cache.load(source, arena);
+        record(cacheLoad, secondsSince(start), allocationCount.load() - allocations);
+        if (!cached) throw std::runtime_error("AST cache entry could not be loaded");
+
+        // Function bodies skipped by brace matching, as for large inputs.
+        arena.reset();
+        allocations = allocationCount.load();
+        start = Clock::now();
+        Lexer lazyLexer(source);
+        Parser lazyParser(lazyLexer, source, arena);
+        lazyParser.deferFunctionBodies(true);
+        lazyParser.parse();
+        record(lazyStream, secondsSince(start), allocationCount.load() - allocations);
+        arena.reset();
+    }
+    std::filesystem::remove_all(cacheDir);
+    report("lex", corpus.name, label, source.size(), tokenCount, 0, lex);
+    report("parse", corpus.name, label, source.size(), tokenCount, nodeCount, parse);
+    report("parse-parallel", corpus.name, label, source.size(), tokenCount, nodeCount, parallelParse);
+    report("flatten", corpus.name, label, source.size(), tokenCount, nodeCount, flattening);
+    report("dispatch-rtti", corpus.name, label, source.size(), tokenCount, nodeCount, rttiDispatch);
+    report("dispatch-tag", corpus.name, label, source.size(), tokenCount, nodeCount, tagDispatch);
+    report("teardown", corpus.name, label, source.size(), tokenCount, nodeCount, teardown);
+    report("lex+parse", corpus.name, label, source.size(), tokenCount, nodeCount, stream);
+    report("lex+parse-lazy", corpus.name, label, source.size(), tokenCount, nodeCount, lazyStream);
+    report("cache-load", corpus.name, label, source.size(), tokenCount, nodeCount, cacheLoad);
+    std::fflush(stdout);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t megabytes = 4;
+    int iterations = 5;
+    size_t threads = std::thread::hardware_concurrency();
+    std::string only;
+    std::string dump;
+    std::string label;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--size" && hasValue) megabytes = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--iterations" && hasValue) iterations = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--threads" && hasValue) threads = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--corpus" && hasValue) only = argv[++i];
+        else if (arg == "--dump" && hasValue) dump = argv[++i];
+        else if (arg == "--label" && hasValue) label = argv[++i];
+        else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--size MB] [--iterations N] [--threads N] [--corpus NAME] [--label TEXT] [--dump NAME]" << std::endl;
+            return 1;
+        }
+    }
+
+    try {
+        const size_t bytes = megabytes * 1024 * 1024;
+        if (!dump.empty()) {
+            std::cout << findCorpus(dump).generate(bytes);
+            return 0;
+        }
+        ThreadPool pool(threads);
+        if (!only.empty()) {
+            benchmark(findCorpus(only), bytes, iterations, pool, label);
+        } else {
+            for (const Corpus& corpus : corpora) benchmark(corpus, bytes, iterations, pool, label);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Fixed-length array whose storage lives in an Arena.
+template <typename T>
+struct ArenaList {
+    T* items = nullptr;
+    size_t count = 0;
+
+    T* begin() const { return items; }
+    T* end() const { return items + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T& operator[](size_t i) const { return items[i]; }
+};
+
+// Bump allocator that owns the AST of one compilation. Objects are placed
+// back to back in large blocks and are never destroyed one by one: the
+// blocks are released together when the arena goes away, so only trivially
+// destructible types may be allocated here.
+class Arena {
+public:
+    explicit Arena(size_t blockSize = 64 * 1024) : blockSize(blockSize) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t align) {
+        size_t pad = (align - reinterpret_cast<uintptr_t>(cursor) % align) % align;
+        if (size + pad > static_cast<size_t>(limit - cursor)) return allocateSlow(size, align);
+        void* result = cursor + pad;
+        cursor += pad + size;
+        return result;
+    }
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        static_assert(std::is_trivially_destructible_v<T>, "arena objects are never destroyed");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    ArenaList<T> copy(const T* items, size_t count) {
+        static_assert(std::is_trivially_copyable_v<T>, "arena lists are copied bytewise");
+        if (count == 0) return {};
+        T* storage = static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+        std::uninitialized_copy(items, items + count, storage);
+        return {storage, count};
+    }
+
+    // Takes over all of `other`'s blocks, leaving it empty. Objects allocated
+    // from `other` stay valid and now live as long as this arena.
+    void adopt(Arena& other);
+
+    // Frees every block at once; everything allocated so far becomes invalid.
+    void reset();
+
+    // Like reset(), but keeps the current block for the next allocations, so
+    // an arena refilled over and over (one statement at a time) does not go
+    // back to the heap each round.
+    void rewind();
+
+    // Bytes handed out so far, including alignment padding.
+    size_t bytesUsed() const { return used + static_cast<size_t>(cursor - blockStart); }
+
+private:
+    void* allocateSlow(size_t size, size_t align);
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* blockStart = nullptr;
+    char* cursor = nullptr;
+    char* limit = nullptr;
+    size_t used = 0;  // bytes in blocks before the current one
+    size_t blockSize;
+};
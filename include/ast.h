@@ -1,10 +1,28 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
-#include <memory>
+#include "arena.h"
+#include "interner.h"
 #include "lexer.h"
 
+// Nodes keep compact Tokens that point into the source buffer, so printing a
+// node (toString, printAst) needs that same source. Nodes and their child
+// lists are allocated in an Arena owned by the caller of Parser::parse and
+// are never destroyed individually. Names also carry their interned Symbol, so later
+// passes can key tables by integer instead of by text, and variables the slot
+// the Resolver binds them to. TypeInference fills in the static types.
+
+// Static type of a value. Unknown is only seen while TypeInference runs;
+// every node the code generator lowers has one of the others.
+enum class ValueType : uint8_t { Unknown, Int, Double, Bool, String };
+
+// Node kind tags. Passes dispatch on these with a switch and then
+// static_cast, instead of trying one dynamic_cast per node class.
+enum class ExprKind : uint8_t { Binary, Unary, Literal, Variable, Assign, Call, Grouping };
+enum class StmtKind : uint8_t { Expression, Print, Var, Block, If, While, For, Function, Return };
+
 // Forward declarations
 class Expr;
 class Stmt;
@@ -25,136 +43,120 @@ public:
 // Base expression class
 class Expr {
 public:
-    virtual ~Expr() = default;
+    const ExprKind kind;
+    ValueType type = ValueType::Unknown;  // set by TypeInference
+
     virtual void accept(ExprVisitor* visitor) = 0;
-    virtual std::string toString() const = 0;
+    std::string toString(std::string_view source) const;  // see printAst
+
+protected:
+    explicit Expr(ExprKind kind) : kind(kind) {}
+    ~Expr() = default;  // arena-owned: never deleted through a base pointer
 };
 
 // Binary expression (e.g., 1 + 2)
 class BinaryExpr : public Expr {
 public:
-    std::unique_ptr<Expr> left;
+    Expr* left;
     Token op;
-    std::unique_ptr<Expr> right;
+    Expr* right;
 
-    BinaryExpr(std::unique_ptr<Expr> left, Token op, std::unique_ptr<Expr> right)
-        : left(std::move(left)), op(op), right(std::move(right)) {}
+    BinaryExpr(Expr* left, Token op, Expr* right)
+        : Expr(ExprKind::Binary), left(left), op(op), right(right) {}
 
     void accept(ExprVisitor* visitor) override {
         visitor->visitBinaryExpr(this);
     }
-
-    std::string toString() const override {
-        return "BinaryExpr(" + left->toString() + ", " + op.value + ", " + right->toString() + ")";
-    }
 };
 
 // Unary expression (e.g., -5)
 class UnaryExpr : public Expr {
 public:
     Token op;
-    std::unique_ptr<Expr> right;
+    Expr* right;
 
-    UnaryExpr(Token op, std::unique_ptr<Expr> right)
-        : op(op), right(std::move(right)) {}
+    UnaryExpr(Token op, Expr* right)
+        : Expr(ExprKind::Unary), op(op), right(right) {}
 
     void accept(ExprVisitor* visitor) override {
         visitor->visitUnaryExpr(this);
     }
-
-    std::string toString() const override {
-        return "UnaryExpr(" + op.value + ", " + right->toString() + ")";
-    }
 };
 
 // Literal expression (e.g., 42, "hello")
 class LiteralExpr : public Expr {
 public:
     Token value;
+    // Literals made by the ConstantFolder have no text of their own: `value`
+    // is the operator they replaced, and `constant` holds the int, double
+    // or bool (0 or 1) result, all of which a double represents exactly.
+    bool folded = false;
+    double constant = 0;
 
-    explicit LiteralExpr(Token value) : value(value) {}
+    explicit LiteralExpr(Token value) : Expr(ExprKind::Literal), value(value) {}
 
     void accept(ExprVisitor* visitor) override {
         visitor->visitLiteralExpr(this);
     }
-
-    std::string toString() const override {
-        return "LiteralExpr(" + value.value + ")";
-    }
 };
 
 // Variable expression (e.g., x)
 class VariableExpr : public Expr {
 public:
     Token name;
+    Symbol symbol;
+    uint32_t slot = 0;  // set by the Resolver
 
-    explicit VariableExpr(Token name) : name(name) {}
+    VariableExpr(Token name, Symbol symbol) : Expr(ExprKind::Variable), name(name), symbol(symbol) {}
 
     void accept(ExprVisitor* visitor) override {
         visitor->visitVariableExpr(this);
     }
-
-    std::string toString() const override {
-        return "VariableExpr(" + name.value + ")";
-    }
 };
 
 // Assignment expression (e.g., x = 5)
 class AssignExpr : public Expr {
 public:
     Token name;
-    std::unique_ptr<Expr> value;
+    Symbol symbol;
+    uint32_t slot = 0;  // set by the Resolver
+    Expr* value;
 
-    AssignExpr(Token name, std::unique_ptr<Expr> value)
-        : name(name), value(std::move(value)) {}
+    AssignExpr(Token name, Symbol symbol, Expr* value)
+        : Expr(ExprKind::Assign), name(name), symbol(symbol), value(value) {}
 
     void accept(ExprVisitor* visitor) override {
         visitor->visitAssignExpr(this);
     }
-
-    std::string toString() const override {
-        return "AssignExpr(" + name.value + ", " + value->toString() + ")";
-    }
 };
 
 // Function call expression (e.g., foo(x, y))
 class CallExpr : public Expr {
 public:
     Token callee;
-    std::vector<std::unique_ptr<Expr>> arguments;
+    Symbol symbol;  // of the callee
+    ArenaList<Expr*> arguments;
+    uint32_t signature = UINT32_MAX;  // the callee's specialization; set by TypeInference
 
-    CallExpr(Token callee, std::vector<std::unique_ptr<Expr>> arguments)
-        : callee(callee), arguments(std::move(arguments)) {}
+    CallExpr(Token callee, Symbol symbol, ArenaList<Expr*> arguments)
+        : Expr(ExprKind::Call), callee(callee), symbol(symbol), arguments(arguments) {}
 
     void accept(ExprVisitor* visitor) override {
         visitor->visitCallExpr(this);
     }
-
-    std::string toString() const override {
-        std::string result = "CallExpr(" + callee.value + ", [";
-        for (const auto& arg : arguments) {
-            result += arg->toString() + ", ";
-        }
-        result += "])";
-        return result;
-    }
 };
 
 // Grouping expression (e.g., (1 + 2))
 class GroupingExpr : public Expr {
 public:
-    std::unique_ptr<Expr> expression;
+    Expr* expression;
 
-    explicit GroupingExpr(std::unique_ptr<Expr> expression)
-        : expression(std::move(expression)) {}
+    explicit GroupingExpr(Expr* expression)
+        : Expr(ExprKind::Grouping), expression(expression) {}
 
     void accept(ExprVisitor* visitor) override {
         visitor->visitGroupingExpr(this);
     }
-
-    std::string toString() const override {
-        return "GroupingExpr(" + expression->toString() + ")";
-    }
 };
 
 // Statement visitor interface
@@ -175,196 +177,179 @@ public:
 // Base statement class
 class Stmt {
 public:
-    virtual ~Stmt() = default;
+    const StmtKind kind;
+
     virtual void accept(StmtVisitor* visitor) = 0;
-    virtual std::string toString() const = 0;
+    std::string toString(std::string_view source) const;  // see printAst
+
+protected:
+    explicit Stmt(StmtKind kind) : kind(kind) {}
+    ~Stmt() = default;  // arena-owned: never deleted through a base pointer
 };
 
 // Expression statement (e.g., x + 5;)
 class ExprStmt : public Stmt {
 public:
-    std::unique_ptr<Expr> expression;
+    Expr* expression;
 
-    explicit ExprStmt(std::unique_ptr<Expr> expression)
-        : expression(std::move(expression)) {}
+    explicit ExprStmt(Expr* expression)
+        : Stmt(StmtKind::Expression), expression(expression) {}
 
     void accept(StmtVisitor* visitor) override {
         visitor->visitExpressionStmt(this);
     }
-
-    std::string toString() const override {
-        return "ExprStmt(" + expression->toString() + ")";
-    }
 };
 
 // Print statement (e.g., print x;)
 class PrintStmt : public Stmt {
 public:
-    std::unique_ptr<Expr> expression;
+    Expr* expression;
 
-    explicit PrintStmt(std::unique_ptr<Expr> expression)
-        : expression(std::move(expression)) {}
+    explicit PrintStmt(Expr* expression)
+        : Stmt(StmtKind::Print), expression(expression) {}
 
     void accept(StmtVisitor* visitor) override {
         visitor->visitPrintStmt(this);
     }
-
-    std::string toString() const override {
-        return "PrintStmt(" + expression->toString() + ")";
-    }
 };
 
-// Variable declaration statement (e.g., var x = 5;)
+// Variable declaration statement (e.g., var x = 5; or const y = f(3);)
 class VarStmt : public Stmt {
 public:
     Token name;
-    std::unique_ptr<Expr> initializer;
+    Symbol symbol;
+    uint32_t slot = 0;  // set by the Resolver
+    ValueType type = ValueType::Unknown;  // of the variable; set by TypeInference
+    Expr* initializer;
+    bool constant;  // `const`: never assigned, and its value is known at compile time
 
-    VarStmt(Token name, std::unique_ptr<Expr> initializer)
-        : name(name), initializer(std::move(initializer)) {}
+    VarStmt(Token name, Symbol symbol, Expr* initializer, bool constant = false)
+        : Stmt(StmtKind::Var), name(name), symbol(symbol), initializer(initializer), constant(constant) {}
 
     void accept(StmtVisitor* visitor) override {
         visitor->visitVarStmt(this);
     }
-
-    std::string toString() const override {
-        return "VarStmt(" + name.value + ", " + (initializer ? initializer->toString() : "null") + ")";
-    }
 };
 
 // Block statement (e.g., { x = 5; y = 6; })
 class BlockStmt : public Stmt {
 public:
-    std::vector<std::unique_ptr<Stmt>> statements;
+    ArenaList<Stmt*> statements;
 
-    explicit BlockStmt(std::vector<std::unique_ptr<Stmt>> statements)
-        : statements(std::move(statements)) {}
+    explicit BlockStmt(ArenaList<Stmt*> statements)
+        : Stmt(StmtKind::Block), statements(statements) {}
 
     void accept(StmtVisitor* visitor) override {
         visitor->visitBlockStmt(this);
     }
-
-    std::string toString() const override {
-        std::string result = "BlockStmt([";
-        for (const auto& stmt : statements) {
-            result += stmt->toString() + ", ";
-        }
-        result += "])";
-        return result;
-    }
 };
 
 // If statement (e.g., if (x > 5) { ... } else { ... })
 class IfStmt : public Stmt {
 public:
-    std::unique_ptr<Expr> condition;
-    std::unique_ptr<Stmt> thenBranch;
-    std::unique_ptr<Stmt> elseBranch;
-
-    IfStmt(std::unique_ptr<Expr> condition,
-           std::unique_ptr<Stmt> thenBranch,
-           std::unique_ptr<Stmt> elseBranch)
-        : condition(std::move(condition)),
-          thenBranch(std::move(thenBranch)),
-          elseBranch(std::move(elseBranch)) {}
+    Expr* condition;
+    Stmt* thenBranch;
+    Stmt* elseBranch;
+
+    IfStmt(Expr* condition,
+           Stmt* thenBranch,
+           Stmt* elseBranch)
+        : Stmt(StmtKind::If),
+          condition(condition),
+          thenBranch(thenBranch),
+          elseBranch(elseBranch) {}
 
     void accept(StmtVisitor* visitor) override {
         visitor->visitIfStmt(this);
     }
-
-    std::string toString() const override {
-        return "IfStmt(" + condition->toString() + ", " + thenBranch->toString() + ", " + elseBranch->toString() + ")";
-    }
 };
 
 // While statement (e.g., while (x > 0) { ... })
 class WhileStmt : public Stmt {
 public:
-    std::unique_ptr<Expr> condition;
-    std::unique_ptr<Stmt> body;
+    Expr* condition;  // null means "always true" (e.g. a desugared for (;;))
+    Stmt* body;
 
-    WhileStmt(std::unique_ptr<Expr> condition, std::unique_ptr<Stmt> body)
-        : condition(std::move(condition)), body(std::move(body)) {}
+    WhileStmt(Expr* condition, Stmt* body)
+        : Stmt(StmtKind::While), condition(condition), body(body) {}
 
     void accept(StmtVisitor* visitor) override {
         visitor->visitWhileStmt(this);
     }
-
-    std::string toString() const override {
-        return "WhileStmt(" + condition->toString() + ", " + body->toString() + ")";
-    }
 };
 
 // For statement (e.g., for (var i = 0; i < 10; i = i + 1) { ... })
 class ForStmt : public Stmt {
 public:
-    std::unique_ptr<Stmt> initializer;
-    std::unique_ptr<Expr> condition;
-    std::unique_ptr<Expr> increment;
-    std::unique_ptr<Stmt> body;
-
-    ForStmt(std::unique_ptr<Stmt> initializer,
-            std::unique_ptr<Expr> condition,
-            std::unique_ptr<Expr> increment,
-            std::unique_ptr<Stmt> body)
-        : initializer(std::move(initializer)),
-          condition(std::move(condition)),
-          increment(std::move(increment)),
-          body(std::move(body)) {}
+    Stmt* initializer;
+    Expr* condition;
+    Expr* increment;
+    Stmt* body;
+
+    ForStmt(Stmt* initializer,
+            Expr* condition,
+            Expr* increment,
+            Stmt* body)
+        : Stmt(StmtKind::For),
+          initializer(initializer),
+          condition(condition),
+          increment(increment),
+          body(body) {}
 
     void accept(StmtVisitor* visitor) override {
         visitor->visitForStmt(this);
     }
-
-    std::string toString() const override {
-        return "ForStmt(" + initializer->toString() + ", " + condition->toString() + ", " + increment->toString() + ", " + body->toString() + ")";
-    }
 };
 
 // Function declaration statement (e.g., fun foo(x, y) { ... })
 class FunctionStmt : public Stmt {
 public:
     Token name;
-    std::vector<Token> params;
-    std::vector<std::unique_ptr<Stmt>> body;
+    Symbol symbol;
+    ArenaList<Token> params;
+    ArenaList<Symbol> paramSymbols;  // parallel to params
+    ArenaList<Stmt*> body;
+    // Lazy parsing: a deferred function has an empty `body` and remembers
+    // the '{' that opens it; Parser::parseBody fills the body in on demand.
+    bool deferred = false;
+    Token bodyStart{TokenType::UNKNOWN, 0, 0, 0, 0};
+    uint32_t signature = UINT32_MAX;  // index of its types in TypeInference
+
+    FunctionStmt(Token name,
+                 Symbol symbol,
+                 ArenaList<Token> params,
+                 ArenaList<Symbol> paramSymbols,
+                 ArenaList<Stmt*> body)
+        : Stmt(StmtKind::Function), name(name), symbol(symbol), params(params), paramSymbols(paramSymbols), body(body) {}
 
     FunctionStmt(Token name,
-                 std::vector<Token> params,
-                 std::vector<std::unique_ptr<Stmt>> body)
-        : name(name), params(std::move(params)), body(std::move(body)) {}
+                 Symbol symbol,
+                 ArenaList<Token> params,
+                 ArenaList<Symbol> paramSymbols,
+                 Token bodyStart)
+        : Stmt(StmtKind::Function), name(name), symbol(symbol), params(params), paramSymbols(paramSymbols),
+          deferred(true), bodyStart(bodyStart) {}
 
     void accept(StmtVisitor* visitor) override {
         visitor->visitFunctionStmt(this);
     }
-
-    std::string toString() const override {
-        std::string result = "FunctionStmt(" + name.value + ", [";
-        for (const auto& param : params) {
-            result += param.value + ", ";
-        }
-        result += "], [";
-        for (const auto& stmt : body) {
-            result += stmt->toString() + ", ";
-        }
-        result += "])";
-        return result;
-    }
 };
 
 // Return statement (e.g., return x;)
 class ReturnStmt : public Stmt {
 public:
     Token keyword;
-    std::unique_ptr<Expr> value;
+    Expr* value;
 
-    ReturnStmt(Token keyword, std::unique_ptr<Expr> value)
-        : keyword(keyword), value(std::move(value)) {}
+    ReturnStmt(Token keyword, Expr* value)
+        : Stmt(StmtKind::Return), keyword(keyword), value(value) {}
 
     void accept(StmtVisitor* visitor) override {
         visitor->visitReturnStmt(this);
     }
+};
 
-    std::string toString() const override {
-        return "ReturnStmt(" + keyword.value + ", " + (value ? value->toString() : "null") + ")";
-    }
-}; 
\ No newline at end of file
+// Appends the text of `stmt` or `expr` to `out`. Works from an explicit
+// stack, so arbitrarily deep trees print without recursion.
+void printAst(const Stmt* stmt, std::string_view source, std::string& out);
+void printAst(const Expr* expr, std::string_view source, std::string& out);
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "arena.h"
+#include "ast.h"
+
+// Compiler version baked into every cache key, so stale entries are never
+// loaded. The Makefile and CMakeLists.txt pass a checksum of the lexer and
+// parser sources; the fallback only serves builds that do neither.
+#ifndef GRAN_VERSION
+#define GRAN_VERSION "1.0"
+#endif
+
+// 64-bit content hash of `source`, used as the cache key.
+uint64_t hashSource(std::string_view source);
+
+// On-disk cache of parsed programs, so repeat runs on an unchanged file skip
+// lexing and parsing. An entry is the FlatAst of one source written as raw
+// arrays behind a fixed header, stored under a name derived from the source
+// hash and the compiler version, with a hash of the arrays in the header so
+// a damaged entry is rejected. Loading maps the entry and rebuilds the
+// pointer tree in an Arena; the tokens still point into the source text,
+// which the caller already has in memory.
+class AstCache {
+public:
+    // Entries are several times the size of their source, so the directory
+    // is kept under a size limit: each store() deletes the least recently
+    // used entries (by modification time, which a hit refreshes) beyond it.
+    static constexpr uint64_t DefaultMaxBytes = uint64_t(128) << 20;
+
+    // Entries live in `directory`; an empty directory disables the cache.
+    explicit AstCache(std::string directory, uint64_t maxBytes = DefaultMaxBytes);
+
+    // $GRAN_CACHE_DIR, else $XDG_CACHE_HOME/gran, else $HOME/.cache/gran.
+    // GRAN_CACHE=0 disables the cache; GRAN_CACHE_MAX_MB sets the limit.
+    static AstCache fromEnvironment();
+
+    bool enabled() const { return !directory.empty(); }
+
+    // The statements cached for `source`, allocated in `arena`, or nothing on
+    // a miss. Missing, truncated, stale or corrupt entries are all misses.
+    std::optional<std::vector<Stmt*>> load(std::string_view source, Arena& arena) const;
+
+    // Writes the entry for `source`. The cache is best effort: returns false
+    // instead of throwing when the entry cannot be written.
+    bool store(std::string_view source, const std::vector<Stmt*>& statements) const;
+
+    std::string entryPath(std::string_view source) const;
+
+private:
+    void evict() const;
+
+    std::string directory;
+    uint64_t maxBytes;
+};
@@ -0,0 +1,107 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "arena.h"
+#include "ast.h"
+#include "evaluator.h"
+#include "type_inference.h"
+
+// Shrinks the AST before code generation, so LLVM has less IR to build and
+// to compile at -O0. Runs after TypeInference, whose types it relies on and
+// keeps valid:
+//  - arithmetic, comparisons and unary operators on literals become a single
+//    literal (ints wrap like the i32 code they replace; a division by zero
+//    is left for run time);
+//  - a call whose arguments are all literals is run by the Evaluator, and
+//    becomes its result if the callee turns out pure and quick enough;
+//  - a `const` must be left with a literal initializer, which then replaces
+//    every use of it (the declaration itself goes);
+//  - an `if` on a constant becomes the branch it takes, a loop whose
+//    condition is constantly false disappears, and one that is constantly
+//    true gets a null condition, which lowers to an unconditional branch;
+//  - statements after one that always returns (or loops forever) are
+//    dropped, as are expression statements left with nothing but a literal.
+// Rewritten children are written back into their parents in place; new
+// literals come from `arena`. Like the other passes it works off an
+// explicit stack rather than recursing.
+class ConstantFolder {
+public:
+    ConstantFolder(Arena& arena, std::string_view source, const TypeInference& types)
+        : arena(arena), source(source), evaluator(types, source) {}
+
+    // Folds `stmt` and returns what should replace it: itself, another
+    // statement, or null if nothing is left to run. Function definitions in
+    // it are left as they are.
+    Stmt* fold(Stmt* stmt);
+
+    // Folds a function's body, in place. Run on every body that is lowered,
+    // after TypeInference has typed it; nested definitions are again left
+    // for their own turn.
+    void foldFunction(FunctionStmt* function);
+
+private:
+    // Visiting a node pushes the task that finishes it below those of its
+    // children. Finished expressions leave their replacement on `exprs` and
+    // statements on `stmts`, where the parent's task collects them.
+    // `exits` marks a statement after which nothing runs: it returns on
+    // every path, or loops forever (`break` is not implemented).
+    struct Task {
+        enum Kind : uint8_t {
+            VisitStmt, VisitExpr,
+            Discard, Print, Var, Block, Branch, Loop, ForLoop, Function, Return,  // statement epilogues
+            Binary, Unary, Grouping, Assign, Call,                                // expression epilogues
+        } kind;
+        Stmt* stmt = nullptr;
+        Expr* expr = nullptr;
+        size_t frame = 0;  // Function: the enclosing function's frame
+    };
+
+    struct Result {
+        Stmt* stmt;
+        bool exits;
+    };
+
+    // Value of a `const` in scope, by slot, copied out of its literal since
+    // a streamed statement's nodes are freed after it is lowered.
+    struct Constant {
+        bool known = false;
+        bool folded = false;
+        double value = 0;
+        Token token{TokenType::UNKNOWN, 0, 0, 0, 0};
+    };
+
+    void run();
+    void visitStmt(Stmt* stmt);
+    void visitExpr(Expr* expr);
+    Result finish(const Task& task);
+    Expr* finishExpr(const Task& task);
+    bool takeList(ArenaList<Stmt*>& list);  // true if the list exits
+    Expr* binary(BinaryExpr* expr);
+    Expr* unary(UnaryExpr* expr);
+    Expr* call(CallExpr* expr);
+    bool constant(const Expr* expr, double& value) const;
+    LiteralExpr* literal(Token token, ValueType type, double value);
+
+    Expr* popExpr() {
+        Expr* expr = exprs.back();
+        exprs.pop_back();
+        return expr;
+    }
+    Result popStmt() {
+        Result result = stmts.back();
+        stmts.pop_back();
+        return result;
+    }
+
+    Arena& arena;
+    std::string_view source;
+    Evaluator evaluator;
+    std::vector<double> arguments;  // of the call being folded
+    std::vector<Constant> constants;  // by frame + slot, as the code generator's allocas
+    size_t frame = 0;
+    std::vector<Task> tasks;
+    std::vector<Expr*> exprs;
+    std::vector<Result> stmts;
+};
@@ -0,0 +1,104 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string_view>
+#include <vector>
+#include "ast.h"
+#include "type_inference.h"
+
+// Runs calls at compile time, for the ConstantFolder: a call whose arguments
+// are all constants is interpreted on the typed AST and, if that works out,
+// replaced by its result. Only what is pure and terminates gets that far:
+// a body that prints gives up, and so does one that handles strings, divides
+// by zero (which traps at run time) or runs out of its step budget. Functions
+// cannot see main's variables, so printing is the only side effect there is.
+//
+// Values are doubles, which hold every int and bool exactly; the types that
+// TypeInference wrote into the nodes say which arithmetic applies, so ints
+// wrap as the generated i32 code does. Like the other passes it works off
+// an explicit stack: deep recursion in the program only costs steps.
+//
+// Every outcome is remembered per signature and argument values, failures
+// included, so a repeated call costs a lookup. A callee that printed or ran
+// out of steps is not run again at all, whatever its arguments.
+class Evaluator {
+public:
+    // Tasks run per call before giving up.
+    static constexpr size_t StepBudget = 1000000;
+
+    Evaluator(const TypeInference& types, std::string_view source) : types(types), source(source) {}
+
+    // Runs `call` with the given argument values. Returns false, leaving
+    // the call for run time, if it cannot be evaluated.
+    bool evaluate(const CallExpr* call, const std::vector<double>& arguments, double& result);
+
+    // The arithmetic of the generated code, shared with the ConstantFolder.
+    // Each computes a node from the values of its operands and returns
+    // false if it cannot: an integer division that traps, or a string.
+    static bool literal(const LiteralExpr* expr, std::string_view source, double& value);
+    static bool binary(const BinaryExpr* expr, std::string_view source, double left, double right, double& value);
+    static bool unary(const UnaryExpr* expr, std::string_view source, double operand, double& value);
+
+private:
+    // Why a run stopped. A trap (division by zero) depends on the
+    // arguments; printing, a string or a callee that cannot be run
+    // (Unsupported) and running out of steps are taken to mean the callee
+    // is not worth running again.
+    enum class Failure : uint8_t { None, Trap, Unsupported, OutOfSteps };
+
+    // A call already evaluated: its signature, then the bits of each
+    // argument (NaN would not compare equal as a double).
+    using Key = std::vector<uint64_t>;
+    struct Outcome {
+        bool evaluated;
+        double result;
+    };
+
+    struct Task {
+        enum Kind : uint8_t {
+            Exec, Eval,
+            Discard, Declare, Branch, Loop, ForLoop, Return, EndCall,  // statements
+            Binary, Unary, Assign, Call,                               // expressions, after their operands
+        } kind;
+        const Stmt* stmt = nullptr;
+        const Expr* expr = nullptr;
+    };
+
+    // One active call. Its variables are slots[frame.slots + slot].
+    struct Frame {
+        size_t slots;
+        size_t tasks;   // tasks.size() once the body was queued; a return unwinds to it
+        bool returned;  // else it falls off the end and yields 0
+    };
+
+    bool run();
+    bool fail(Failure why) {
+        failure = why;
+        return false;
+    }
+    bool exec(const Stmt* stmt);
+    bool eval(const Expr* expr);
+    bool call(const CallExpr* expr);
+    double& slot(uint32_t index) {
+        size_t at = frames.back().slots + index;
+        if (at >= slots.size()) slots.resize(at + 1);
+        return slots[at];
+    }
+    double pop() {
+        double value = values.back();
+        values.pop_back();
+        return value;
+    }
+
+    const TypeInference& types;
+    std::string_view source;
+    std::vector<Task> tasks;
+    std::vector<double> values;
+    std::vector<double> slots;
+    std::vector<Frame> frames;
+    Failure failure = Failure::None;
+
+    std::map<Key, Outcome> outcomes;
+    std::vector<bool> unevaluable;  // by signature
+};
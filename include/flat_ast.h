@@ -0,0 +1,110 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ast.h"
+#include "lexer.h"
+
+// Index-based AST stored as a struct of arrays: entry i of every array
+// describes node i, so a pass over one field walks one contiguous array.
+// Nodes refer to each other by 32-bit NodeId; variable-length child lists
+// are ranges of `lists`. Children are always stored before their parent.
+//
+// Field use per kind (unused fields are NoNode / 0):
+//   Binary    token=op       a=left       b=right
+//   Unary     token=op       a=operand
+//   Literal   token=value
+//   Variable  token=name
+//   Assign    token=name     a=value
+//   Call      token=callee   list=arguments
+//   Grouping                 a=expression
+//   ExprStmt                 a=expression
+//   Print                    a=expression
+//   Var       token=name     a=initializer (or NoNode)
+//   Const     token=name     a=initializer
+//   Block                    list=statements
+//   If                       a=condition  b=then  c=else (or NoNode)
+//   While                    a=condition (NoNode means true)  b=body
+//   For                      list=[initializer, condition, increment, body]
+//   Function  token=name     a=parameter count  list=[parameters..., body...]
+//                            (parameters are Variable nodes)
+//   Return    token=keyword  a=value (or NoNode)
+//   DeferredFunction         a function whose body was not parsed yet:
+//             token=name     a=a Literal node holding the body's '{'
+//                            list=[parameters...]
+// Lists keep their start in `b` and their length in `c`. Entries of a
+// statement list may be NoNode where the parser produced no statement.
+
+using NodeId = uint32_t;
+constexpr NodeId NoNode = UINT32_MAX;
+
+enum class NodeKind : uint8_t {
+    Binary, Unary, Literal, Variable, Assign, Call, Grouping,
+    ExprStmt, Print, Var, Const, Block, If, While, For, Function, Return,
+    DeferredFunction,
+};
+
+struct FlatList {
+    const NodeId* items;
+    uint32_t count;
+
+    const NodeId* begin() const { return items; }
+    const NodeId* end() const { return items + count; }
+    uint32_t size() const { return count; }
+    NodeId operator[](uint32_t i) const { return items[i]; }
+};
+
+// Read-only view of the arrays of a FlatAst, which may live somewhere other
+// than the vectors themselves (e.g. a memory-mapped cache file).
+struct FlatAstView {
+    const NodeKind* kinds;
+    const Token* tokens;
+    const NodeId* a;
+    const NodeId* b;
+    const NodeId* c;
+    const NodeId* lists;
+    const NodeId* roots;
+    size_t nodeCount;
+    size_t listCount;
+    size_t rootCount;
+};
+
+class FlatAst {
+public:
+    std::vector<NodeKind> kinds;
+    std::vector<Token> tokens;
+    std::vector<NodeId> a;
+    std::vector<NodeId> b;
+    std::vector<NodeId> c;
+    std::vector<NodeId> lists;
+    std::vector<NodeId> roots;  // top-level statements, in order
+
+    size_t size() const { return kinds.size(); }
+
+    FlatAstView view() const {
+        return {kinds.data(), tokens.data(), a.data(), b.data(), c.data(), lists.data(), roots.data(),
+                kinds.size(), lists.size(), roots.size()};
+    }
+
+    // Children of a Call, Block, For, Function or DeferredFunction node.
+    FlatList list(NodeId node) const { return {lists.data() + b[node], c[node]}; }
+
+    // Same text as the pointer tree's toString() for the equivalent node.
+    std::string toString(NodeId node, std::string_view source) const;
+
+    NodeId add(NodeKind kind, const Token& token, NodeId first = NoNode,
+               NodeId second = NoNode, NodeId third = NoNode);
+    NodeId addList(NodeKind kind, const Token& token, const NodeId* items, size_t count,
+                   NodeId first = NoNode);
+};
+
+// Converts a parsed pointer tree into a FlatAst. The tree is left untouched,
+// so code that still walks it keeps working during the migration.
+FlatAst flatten(const std::vector<Stmt*>& statements);
+
+// Rebuilds the pointer tree from flat arrays, allocating the nodes in
+// `arena`. The arrays are checked while converting (child order, list
+// bounds, token ranges within `source`), so untrusted input fails with
+// std::runtime_error instead of producing a dangling tree.
+std::vector<Stmt*> unflatten(const FlatAstView& ast, std::string_view source, Arena& arena);
@@ -0,0 +1,109 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include "arena.h"
+
+// Dense id of an interned identifier: the n-th distinct name gets n - 1, so
+// per-name tables can be plain vectors indexed by symbol.
+using Symbol = uint32_t;
+constexpr Symbol NoSymbol = UINT32_MAX;
+
+// Maps identifier text to Symbols. Safe to use from several threads at once
+// (the parallel parser shares one): names are spread over independently
+// locked shards, and the symbol -> text table grows in buckets that never
+// move, so name() takes no lock. Interned text lives as long as the interner.
+class Interner {
+public:
+    Interner();
+    ~Interner();
+
+    Interner(const Interner&) = delete;
+    Interner& operator=(const Interner&) = delete;
+
+    // Returns the symbol for `text`, assigning the next id on first sight.
+    Symbol intern(std::string_view text) { return intern(text, hash(text)); }
+
+    // Text of a symbol returned by intern().
+    std::string_view name(Symbol symbol) const {
+        uint32_t bucket = bucketOf(symbol);
+        return buckets[bucket].load(std::memory_order_acquire)[symbol - bucketStart(bucket)];
+    }
+
+    // Number of symbols handed out so far; tables indexed by symbol need this many slots.
+    size_t size() const { return count.load(std::memory_order_acquire); }
+
+    // Process-wide interner used by the parser and code generator.
+    static Interner& shared();
+
+    // Direct-mapped front for one thread (e.g. one Parser). Names seen
+    // recently resolve without taking a shard lock; a source mentions the
+    // same few identifiers over and over, so most lookups stop here.
+    class Cache {
+    public:
+        explicit Cache(Interner& interner) : interner(interner) {}
+        Symbol intern(std::string_view text);
+
+    private:
+        struct Entry {
+            const char* text = nullptr;  // the interned copy
+            uint32_t size = 0;
+            Symbol symbol = NoSymbol;
+        };
+        Interner& interner;
+        Entry entries[4096];
+    };
+
+private:
+    // Identifiers are short: hash them eight bytes at a time with one
+    // multiply per word.
+    static size_t hash(std::string_view text) {
+        uint64_t h = text.size() * 0x9e3779b97f4a7c15ULL;
+        size_t i = 0;
+        for (; i + 8 <= text.size(); i += 8) {
+            uint64_t word;
+            std::memcpy(&word, text.data() + i, sizeof(word));
+            h = (h ^ word) * 0xff51afd7ed558ccdULL;
+        }
+        uint64_t tail = 0;
+        for (size_t shift = 0; i < text.size(); i++, shift += 8) {
+            tail |= static_cast<uint64_t>(static_cast<unsigned char>(text[i])) << shift;
+        }
+        h = (h ^ tail) * 0xc4ceb9fe1a85ec53ULL;
+        return static_cast<size_t>(h ^ (h >> 29));
+    }
+    Symbol intern(std::string_view text, size_t hash);
+
+    static constexpr size_t ShardCount = 32;
+    static constexpr uint32_t FirstBucketSize = 1024;
+    static constexpr size_t BucketCount = 23;  // enough buckets to cover every 32-bit symbol
+
+    // Bucket b holds FirstBucketSize << b names.
+    static uint32_t bucketOf(Symbol symbol) {
+        return 31 - static_cast<uint32_t>(__builtin_clz(symbol / FirstBucketSize + 1));
+    }
+    static uint32_t bucketStart(uint32_t bucket) { return FirstBucketSize * ((1u << bucket) - 1); }
+
+    struct Key {
+        std::string_view text;
+        size_t hash;
+        bool operator==(const Key& other) const { return text == other.text; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& key) const { return key.hash; }
+    };
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<Key, Symbol, KeyHash> symbols;
+        Arena text{16 * 1024};
+    };
+
+    Shard shards[ShardCount];
+    std::atomic<std::string_view*> buckets[BucketCount] = {};
+    std::mutex growMutex;
+    std::atomic<uint32_t> count{0};
+};
@@ -1,55 +1,158 @@
 #pragma once
 
 #include "ast.h"
+#include "constant_folder.h"
+#include "resolver.h"
+#include "type_inference.h"
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Value.h>
 #include <memory>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <vector>
 
 class IRGenerator {
 public:
-    IRGenerator();
+    explicit IRGenerator(std::string_view source);
     ~IRGenerator();
 
     // Generate IR for the entire program
-    std::unique_ptr<llvm::Module> generate(const std::vector<std::unique_ptr<Stmt>>& statements);
+    std::unique_ptr<llvm::Module> generate(const std::vector<Stmt*>& statements);
+
+    // Streaming use: add() lowers one top-level statement into main, and
+    // finish() closes main and returns the module. add() runs the resolver
+    // and type inference over the statement first, which write slots and
+    // types into it, and the constant folder, which rewrites it; the
+    // statement may be freed once add() returns. A function definition is
+    // copied instead, and lowered along with the first statement that calls
+    // it, whose arguments give it its types.
+    // generate() instead runs both passes over the whole program before
+    // lowering any of it, so types can flow from later statements (a call's
+    // arguments into the parameters of a function defined earlier), and a
+    // function becomes one LLVM function per list of argument types it is
+    // called with. Deferred bodies are parsed when inference finds a call to
+    // them.
+    void add(Stmt* stmt);
+    std::unique_ptr<llvm::Module> finish();
+
+    // Caches the results of pure recursive functions over ints (see
+    // memoizable()) in a table per function, so a call with arguments seen
+    // before returns the stored result instead of running again. Off by
+    // default; set it before generating anything.
+    void memoizePureFunctions(bool enable) { memoize = enable; }
 
 private:
+    // Source buffer the AST tokens point into
+    std::string_view source;
+
     // LLVM context and builder
     llvm::LLVMContext context;
     std::unique_ptr<llvm::Module> module;
     llvm::IRBuilder<> builder;
 
-    // Symbol table for variables
-    std::unordered_map<std::string, llvm::Value*> symbolTable;
+    // Variables live in slots assigned by the resolver: the allocas of the
+    // function being lowered are slots[frame + slot]. Functions are looked up
+    // by the signature TypeInference gave them (one per specialization), and
+    // declared on first use, so a call may precede its callee's body.
+    // `bodies` holds what the function's statements are lowered into: the
+    // function itself, or for a memoized one the internal function behind
+    // its cache.
+    Resolver resolver;
+    TypeInference types;
+    std::vector<llvm::Value*> slots;
+    size_t frame = 0;
+    llvm::Function* mainFunction = nullptr;
+    std::vector<llvm::Function*> functions;
+    std::vector<llvm::Function*> bodies;
+
+    // Memoization: whether it is on, and what is known of each signature's
+    // side effects. A streamed function may be freed once lowered, so its
+    // purity is worked out when it is declared and kept here.
+    enum class Purity : uint8_t { Unknown, Pure, Impure };
+    bool memoize = false;
+    std::vector<Purity> purity;
+
+    // Lazy parsing: type inference parses (into deferredArena) the body of
+    // every deferred function that is called, so one still deferred here is
+    // never called and is not lowered at all.
+    Arena deferredArena;
+
+    // Copies of function bodies made for specializations after the first,
+    // and of streamed function definitions.
+    Arena cloneArena;
+
+    // Literals made by the folder; add() rewinds it after every statement.
+    Arena foldArena;
+    ConstantFolder folder;
+
+    // Lowering runs off an explicit work list instead of recursing, so deep
+    // nesting cannot exhaust the native stack. Visiting a node pushes tasks
+    // for its children followed by the task that finishes it; expression
+    // results travel on `values`, one per visited expression.
+    struct Task {
+        enum Kind : uint8_t {
+            VisitStmt, VisitExpr,
+            Discard, Print, Var, Return,              // statement epilogues
+            Branch, ElseBranch, EndIf,                // if: after the condition, then, else
+            LoopTest, EndLoop,                        // while, for: after the condition, body
+            ForLoop,                                  // for: after the initializer
+            BeginFunction, EndFunction,
+            Binary, Unary, Call, Assign,              // expression epilogues
+        } kind;
+        const Stmt* stmt = nullptr;
+        const Expr* expr = nullptr;
+        llvm::BasicBlock* blocks[3] = {};  // branch targets; EndFunction: entry and the caller's block
+        llvm::Function* function = nullptr;  // Call: the callee; BeginFunction: the function
+        size_t frame = 0;  // EndFunction: the caller's frame
+    };
+    std::vector<Task> tasks;
+    std::vector<llvm::Value*> values;
+
+    void run();  // drains `tasks`
+    void push(Task::Kind kind, const Stmt* stmt) { tasks.push_back({kind, stmt}); }
+    void push(Task::Kind kind, const Expr* expr) { tasks.push_back({kind, nullptr, expr}); }
+    llvm::Value* pop() {
+        llvm::Value* value = values.back();
+        values.pop_back();
+        return value;
+    }
+
+    void beginMain();  // creates main and points the builder at its entry
+    void lower(Stmt* stmt);
 
     // Generate IR for statements
-    void generateStmt(const Stmt* stmt);
-    void generateExprStmt(const ExprStmt* stmt);
-    void generatePrintStmt(const PrintStmt* stmt);
-    void generateVarStmt(const VarStmt* stmt);
-    void generateBlockStmt(const BlockStmt* stmt);
-    void generateIfStmt(const IfStmt* stmt);
-    void generateWhileStmt(const WhileStmt* stmt);
+    void visitStmt(const Stmt* stmt);
+    void generatePrintStmt(llvm::Value* value);
+    void generateVarStmt(const VarStmt* stmt, llvm::Value* initValue);
+    void generateBranch(llvm::Value* cond);
+    void beginLoop(const Stmt* stmt, const Expr* condition, const Expr* increment, const char* prefix);
     void generateFunctionStmt(const FunctionStmt* stmt);
-    void generateReturnStmt(const ReturnStmt* stmt);
-    void generateForStmt(const ForStmt* stmt);
+    FunctionStmt* cloneFunction(const FunctionStmt* stmt);
+    llvm::Function* declareFunction(uint32_t signature);
+    bool memoizable(uint32_t signature);
+    void generateMemoWrapper(llvm::Function* function, llvm::Function* body);
+    void beginFunctionBody(const FunctionStmt* stmt, llvm::Function* function);
 
     // Generate IR for expressions
-    llvm::Value* generateExpr(const Expr* expr);
-    llvm::Value* generateBinaryExpr(const BinaryExpr* expr);
-    llvm::Value* generateUnaryExpr(const UnaryExpr* expr);
+    void visitExpr(const Expr* expr);
+    llvm::Value* generateBinaryExpr(const BinaryExpr* expr, llvm::Value* left, llvm::Value* right);
+    llvm::Value* generateUnaryExpr(const UnaryExpr* expr, llvm::Value* operand);
     llvm::Value* generateLiteralExpr(const LiteralExpr* expr);
     llvm::Value* generateVariableExpr(const VariableExpr* expr);
-    llvm::Value* generateCallExpr(const CallExpr* expr);
-    llvm::Value* generateGroupingExpr(const GroupingExpr* expr);
-    llvm::Value* generateAssignExpr(const AssignExpr* expr);
+    llvm::Function* resolveCallee(const CallExpr* expr);
+    llvm::Value* generateCallExpr(const CallExpr* expr, llvm::Function* callee);
+    llvm::Value* generateAssignExpr(const AssignExpr* expr, llvm::Value* value);
 
     // Helper functions
-    llvm::Type* getLLVMType(const Token& token);
-    llvm::Value* getVariable(const std::string& name);
-    void setVariable(const std::string& name, llvm::Value* value);
+    llvm::Type* getLLVMType(ValueType type);
+    llvm::Value* convert(llvm::Value* value, llvm::Type* type);  // widens int to double
+    llvm::Value* condition(llvm::Value* value);                 // numbers are true when non-zero
+    void branchTo(llvm::BasicBlock* block);
+    std::string text(const Token& token) const { return std::string(token.text(source)); }
+    llvm::Value*& slot(uint32_t index) {
+        if (frame + index >= slots.size()) slots.resize(frame + index + 1);
+        return slots[frame + index];
+    }
 };
\ No newline at end of file
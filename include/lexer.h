@@ -1,11 +1,21 @@
 #pragma once
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <unordered_map>
 
-enum class TokenType {
+enum class TokenType : uint8_t {
     // Keywords
-    KEYWORD,
+    KW_FUNC,
+    KW_IF,
+    KW_ELSE,
+    KW_WHILE,
+    KW_FOR,
+    KW_SCREENIT,
+    KW_RETURN,
+    KW_VAR,
+    KW_CONST,
+    KW_BREAK,
     
     // Literals
     INT_LITERAL,
@@ -34,45 +44,88 @@ enum class TokenType {
     END_OF_FILE
 };
 
+// Compact token: the lexeme is not copied, it is an offset/length span into
+// the source buffer the token was scanned from. Callers resolve the text with
+// text(source); the buffer must outlive every token (and AST node) using it.
 struct Token {
+    uint32_t offset;
+    uint32_t length;
+    uint32_t line;
+    uint16_t column;   // saturates at UINT16_MAX on very long lines
     TokenType type;
-    std::string value;
-    int line;
-    int column;
 
-    Token(TokenType type, const std::string& value, int line, int column)
-        : type(type), value(value), line(line), column(column) {}
+    Token(TokenType type, uint32_t offset, uint32_t length, uint32_t line, uint16_t column)
+        : offset(offset), length(length), line(line), column(column), type(type) {}
 
-    std::string toString() const {
-        return "Token(" + std::to_string(static_cast<int>(type)) + ", \"" + value + "\", " + std::to_string(line) + ", " + std::to_string(column) + ")";
+    std::string_view text(std::string_view source) const {
+        return source.substr(offset, length);
     }
+
+    std::string toString(std::string_view source) const {
+        return "Token(" + std::to_string(static_cast<int>(type)) + ", \"" + std::string(text(source)) + "\", " + std::to_string(line) + ", " + std::to_string(column) + ")";
+    }
+};
+
+static_assert(sizeof(Token) == 16, "Token should stay a 16-byte value type");
+
+class ThreadPool;
+
+// A text edit, in offsets of the source before the edit: `removedLength`
+// bytes at `offset` were replaced by `insertedLength` new bytes.
+struct SourceEdit {
+    size_t offset;
+    size_t removedLength;
+    size_t insertedLength;
+};
+
+// Tokens [first, first + removed) of the old array were replaced by
+// [first, first + inserted) in the updated one.
+struct TokenChange {
+    size_t first;
+    size_t removed;
+    size_t inserted;
 };
 
 class Lexer {
 public:
-    explicit Lexer(const std::string& source);
+    // Scans `source` in place; the buffer must outlive the lexer and its tokens.
+    explicit Lexer(std::string_view source);
     std::vector<Token> scanTokens();
+
+    // Returns the next token, skipping blanks and comments. Once the input is
+    // exhausted every call returns END_OF_FILE.
     Token scanToken();
 
+    // Produces exactly the tokens scanTokens() would, but splits the input at
+    // newlines into chunks of at least `minChunkBytes` and lexes them on
+    // `pool`. Inputs too small to split, or a single-thread pool, fall back
+    // to scanTokens().
+    std::vector<Token> scanTokensParallel(ThreadPool& pool, size_t minChunkBytes = 256 * 1024);
+
+    // Incremental relexing. `tokens` were scanned from the pre-edit text and
+    // this lexer's source is the text after `edit`. Only the damaged window
+    // is relexed, until the scan lines up again with an old token. That window
+    // is spliced into `tokens`, and the old tokens after it are shifted to the
+    // new offsets and lines. The result is what scanTokens() would return for
+    // the new text.
+    TokenChange relex(std::vector<Token>& tokens, const SourceEdit& edit);
+
+    // Moves to the start of `token`, which was scanned from this source, so
+    // the next scanToken() returns it again and scanning continues from there.
+    void seek(const Token& token);
+
 private:
-    std::string source;
+    std::string_view source;
     std::vector<Token> tokens;
     size_t current;
     size_t start;
     size_t line;
-    size_t column;
+    size_t lineStart;
 
     bool isAtEnd() const;
+    void scanRange(size_t begin, size_t end, size_t startLine, size_t startLineStart);
     void scanNextToken();
-    char advance();
-    void addToken(TokenType type, const std::string& value);
-    bool match(char expected);
-    char peek() const;
-    char peekNext() const;
+    void addToken(TokenType type);
+    void addToken(TokenType type, size_t offset, size_t length);
     void string();
-    void number();
-    void identifier();
-    bool isDigit(char c) const;
-    bool isAlpha(char c) const;
-    bool isAlphaNumeric(char c) const;
 };
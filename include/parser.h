@@ -1,50 +1,147 @@
 #pragma once
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
 #include <stdexcept>
 #include "lexer.h"
+#include "token_stream.h"
+
+class ThreadPool;
+#include "arena.h"
 #include "ast.h"
 
+// Operator binding powers, loosest first.
+enum BindingPower : int {
+    BP_NONE,
+    BP_ASSIGNMENT,  // =  (right-associative)
+    BP_EQUALITY,    // == !=
+    BP_RELATIONAL,  // < > <= >=
+    BP_SUM,         // + -
+    BP_PRODUCT,     // * /
+    BP_PREFIX,      // unary - !
+    BP_CALL,        // f(...)
+};
+
 // Parser class
 class Parser {
 private:
-    std::vector<Token> tokens;
-    size_t current = 0;
-
-    Token peek() const;
-    Token advance();
-    bool check(TokenType type) const;
-    bool match(TokenType type);
-    bool isAtEnd() const;
+    TokenStream tokens;
+    std::string_view source;
+    Arena& arena;
+    Interner::Cache names;
+
+    // Child lists are collected on these stacks while a node is being parsed
+    // and then copied into the arena in one piece.
+    std::vector<Stmt*> stmtScratch;
+    std::vector<Expr*> exprScratch;
+
+    template <typename T>
+    ArenaList<T> takeList(std::vector<T>& scratch, size_t base) {
+        ArenaList<T> list = arena.copy(scratch.data() + base, scratch.size() - base);
+        scratch.resize(base);
+        return list;
+    }
+
+    // Token cursor; these run once or more per token, so they are inline.
+    const Token& peek() const { return tokens.peek(); }
+    Token advance() { tokens.advance(); return tokens.previous(); }
+    bool check(TokenType type) const { return !isAtEnd() && peek().type == type; }
+    bool match(TokenType type) {
+        if (!check(type)) return false;
+        advance();
+        return true;
+    }
+    bool isAtEnd() const { return peek().type == TokenType::END_OF_FILE; }
     Token consume(TokenType type, const std::string& message);
-    Token previous() const { return tokens[current - 1]; }
+    const Token& previous() const { return tokens.previous(); }
+    std::string_view text(const Token& token) const { return token.text(source); }
+    Symbol intern(const Token& token) { return names.intern(text(token)); }
+
+    // Statements and expressions nest through blocks, bodies, operands and
+    // arguments. Rather than recursing per level, both parsers keep one
+    // frame per construct still open, so nesting depth is bounded by heap
+    // memory instead of the native stack.
+    struct ExprFrame {
+        enum Kind : uint8_t { Grouping, Unary, Binary, Assign, Call } kind;
+        uint8_t minPower;  // the operand being parsed stops at looser operators
+        Token op;          // Unary, Binary
+        Expr* left;        // Binary, Assign: the left side; Call: the callee
+        size_t base;       // Call: first argument on exprScratch
+    };
+    struct StmtFrame {
+        enum Kind : uint8_t { Block, Function, Then, Else, While, For } kind;
+        Expr* condition = nullptr;        // Then, Else, While, For
+        Expr* increment = nullptr;        // For
+        Stmt* first = nullptr;            // Else: the then-branch; For: the initializer
+        FunctionStmt* function = nullptr; // Function: the body is filled in on close
+        size_t base = 0;                  // Block, Function: first child on stmtScratch
+
+        bool isList() const { return kind == Block || kind == Function; }
+    };
+    std::vector<ExprFrame> exprFrames;
+    std::vector<StmtFrame> stmtFrames;
 
     // Expression parsing methods
-    std::unique_ptr<Expr> expression();
-    std::unique_ptr<Expr> assignment();
-    std::unique_ptr<Expr> comparison();
-    std::unique_ptr<Expr> term();
-    std::unique_ptr<Expr> factor();
-    std::unique_ptr<Expr> unary();
-    std::unique_ptr<Expr> call();
-    std::unique_ptr<Expr> primary();
-    std::unique_ptr<Expr> finishCall(std::unique_ptr<Expr> callee);
+    Expr* expression();
+    Expr* parseExpression(int minPower);
+    int infixPower(const Token& token) const;
+    Expr* finishCall(const ExprFrame& frame);
 
     // Statement parsing methods
-    std::unique_ptr<Stmt> statement();
-    std::unique_ptr<Stmt> screenitStatement();
-    std::unique_ptr<Stmt> expressionStatement();
-    std::unique_ptr<Stmt> ifStatement();
-    std::unique_ptr<Stmt> whileStatement();
-    std::unique_ptr<Stmt> forStatement();
-    std::unique_ptr<Stmt> returnStatement();
-    std::unique_ptr<Stmt> block();
-    std::unique_ptr<Stmt> declaration();
-    std::unique_ptr<Stmt> varDeclaration();
-    std::unique_ptr<Stmt> functionDeclaration();
+    Stmt* statement();
+    Stmt* parseStatement(bool allowDeclaration);
+    bool openStatement(bool allowDeclaration, Stmt*& stmt);  // false: pushed a frame instead
+    Stmt* closeStatement(const StmtFrame& frame, Stmt* body);
+    Stmt* closeList(const StmtFrame& frame);
+    Stmt* screenitStatement();
+    Stmt* expressionStatement();
+    Expr* parenthesized(const char* open, const char* close);
+    void forStatement();
+    Stmt* returnStatement();
+    // Parses top-level declarations until END_OF_FILE or until the token at
+    // index `end` is reached.
+    void parseDeclarations(std::vector<Stmt*>& statements, size_t end = SIZE_MAX);
+    Stmt* declaration();
+    Stmt* varDeclaration(bool constant = false);
+    FunctionStmt* functionDeclaration();  // through the '{'; the body is left empty or deferred
+    ArenaList<Stmt*> functionBody();  // after the '{', through the matching '}'
+    void skipBody();
+
+    bool deferBodies = false;
 
 public:
-    Parser(const std::vector<Token>& tokens);
-    std::vector<std::unique_ptr<Stmt>> parse();
+    // Nodes are allocated in `arena`, which must outlive the returned AST;
+    // names are interned in Interner::shared().
+    // The first form pulls tokens from `lexer` as parsing proceeds; the
+    // second parses an already lexed array, which must outlive the parser.
+    Parser(Lexer& lexer, std::string_view source, Arena& arena);
+    Parser(const std::vector<Token>& tokens, std::string_view source, Arena& arena);
+    std::vector<Stmt*> parse();
+
+    // Parses the next top-level declaration into `stmt` (null for a bare
+    // `break;`), or returns false at the end of the input. Errors end the
+    // program the same way parse() does. Lets a caller handle and free each
+    // statement before reading the next one.
+    bool next(Stmt*& stmt);
+
+    // Lazy mode: function bodies are skipped by brace matching and left
+    // deferred (see FunctionStmt), to be parsed by parseBody() when needed.
+    // Syntax errors inside a body then surface only once it is parsed.
+    void deferFunctionBodies(bool defer) { deferBodies = defer; }
+
+    // Parses a deferred function's body into `arena`; `source` is the text
+    // the function was parsed from. Does nothing if the body is already there.
+    static void parseBody(FunctionStmt* function, std::string_view source, Arena& arena);
+
+    // Same result as Parser(tokens, source, arena).parse(), but cuts the
+    // program before top-level `func` declarations into chunks of at least
+    // `minChunkTokens` tokens and parses them on `pool`. Each chunk gets its
+    // own arena, and `arena` takes those over when the chunks are merged.
+    // `deferBodies` turns on lazy mode for every chunk.
+    static std::vector<Stmt*> parseParallel(const std::vector<Token>& tokens, std::string_view source,
+                                            Arena& arena, ThreadPool& pool,
+                                            size_t minChunkTokens = 16 * 1024,
+                                            bool deferBodies = false);
 }; 
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "ast.h"
+#include "interner.h"
+
+// Binds every variable to a slot before code generation. Slots are numbered
+// per function (parameters first, then declarations in order), so the code
+// generator keeps one flat array of allocas per function and indexes it
+// with the slot written into VarStmt, VariableExpr and AssignExpr. A block's
+// slots are handed out again once it closes, and redeclaring a name in the
+// same scope reuses its slot, so a function needs no more slots than it has
+// variables live at once.
+//
+// Only blocks and function bodies open scopes. A function body sees its
+// own parameters and locals but nothing of the function it is nested in;
+// the code generator could not reach those allocas anyway.
+class Resolver {
+public:
+    Resolver();
+
+    // Resolves one top-level statement. Top-level declarations stay visible
+    // to the statements resolved after it. Deferred function bodies are
+    // left alone until resolveBody(). Throws on an undefined variable.
+    void resolve(Stmt* stmt);
+
+    // Resolves a deferred function's body once the parser has filled it in.
+    void resolveBody(FunctionStmt* function);
+
+private:
+    static constexpr uint32_t NoSlot = UINT32_MAX;
+
+    // Innermost binding of a symbol; only valid inside `function`.
+    struct Binding {
+        uint32_t slot = NoSlot;
+        uint32_t function = 0;
+        uint32_t depth = 0;  // openScopes when it was declared
+        bool constant = false;
+    };
+
+    // Work list, as in the code generator: nothing recurses per level of
+    // nesting. EndScope puts back what the block or function changed.
+    struct Task {
+        enum Kind : uint8_t { VisitStmt, VisitExpr, Declare, EndScope } kind;
+        Stmt* stmt = nullptr;
+        Expr* expr = nullptr;
+        size_t mark = 0;        // EndScope: shadowed.size() on entry
+        uint32_t slot = 0;      // EndScope: nextSlot on entry
+        uint32_t function = 0;  // EndScope: the function being resolved on entry
+    };
+
+    void run();
+    void visitStmt(Stmt* stmt);
+    void visitExpr(Expr* expr);
+    void openScope();
+    void beginFunction(FunctionStmt* stmt);
+    uint32_t declare(Symbol symbol, bool reuse);
+    uint32_t lookup(Symbol symbol) const;
+
+    Interner& interner;
+    std::vector<Binding> bindings;  // by symbol
+    // Bindings replaced inside an open scope; bindings made at the top level
+    // are never undone, so they are not logged.
+    std::vector<std::pair<Symbol, Binding>> shadowed;
+    std::vector<Task> tasks;
+    uint32_t function = 0;       // 0 is main
+    uint32_t functionCount = 0;
+    uint32_t nextSlot = 0;       // first free slot of `function`
+    uint32_t openScopes = 0;
+};
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+
+// Bulk byte-scanning kernels for the lexer. Each kernel has a scalar, an SSE2
+// (16 bytes per step) and an AVX2 (32 bytes per step) version. The best one
+// the CPU supports is picked once at startup. Setting GRAN_SIMD=scalar|sse2|avx2
+// forces a specific version, which is useful for benchmarking and for
+// cross-checking the kernels against each other. A forced version the CPU
+// lacks falls back to the best available one with a warning on stderr;
+// implementation() names what actually runs.
+namespace simd_scan {
+
+// Skips a run of ' ', '\t', '\r' and '\n' starting at `pos` and returns the
+// first position that is not blank (or `end`). For every '\n' it skips it
+// increments `line` and sets `lineStart` to the offset just past it.
+size_t skipBlanks(const char* data, size_t pos, size_t end, size_t& line, size_t& lineStart);
+
+// Returns the position of the first '\n' at or after `pos`, or `end`.
+size_t findNewline(const char* data, size_t pos, size_t end);
+
+// Returns the position of the first '"' at or after `pos`, or `end`.
+// `newlines` gets the number of '\n' bytes before it, and `lastNewline` gets
+// the offset of the last one (left unchanged if there are none).
+size_t findQuote(const char* data, size_t pos, size_t end, size_t& newlines, size_t& lastNewline);
+
+// Name of the selected implementation: "avx2", "sse2" or "scalar".
+const char* implementation();
+
+} // namespace simd_scan
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <string_view>
+
+// Read-only view of a whole source file. Regular files are memory-mapped so
+// the lexer scans the page cache in place; pipes, stdin and other
+// non-seekable inputs are streamed into an owned string instead.
+// Tokens and AST nodes point into this buffer, so it must outlive them.
+class SourceBuffer {
+public:
+    // Opens `path` ("-" means stdin). Throws std::runtime_error on failure.
+    static SourceBuffer fromFile(const std::string& path);
+    static SourceBuffer fromStream(std::istream& in);
+    static SourceBuffer fromString(std::string text);
+
+    SourceBuffer() = default;  // empty buffer
+    SourceBuffer(SourceBuffer&& other) noexcept;
+    SourceBuffer& operator=(SourceBuffer&& other) noexcept;
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+    ~SourceBuffer();
+
+    std::string_view view() const { return std::string_view(data, size); }
+    bool isMapped() const { return mapped; }
+
+private:
+    static SourceBuffer fromDescriptor(int fd);
+    void release();
+
+    const char* data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    std::string owned;  // backing storage when the input is not mapped
+};
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "lexer.h"
+
+// The parser's view of the token sequence. Fed by a Lexer, tokens are pulled
+// one at a time into a small ring buffer, so lexing and parsing interleave and
+// token memory stays constant whatever the input size. It can also walk an
+// array that was lexed up front (e.g. by scanTokensParallel) without copying
+// it; the array must then outlive the stream.
+class TokenStream {
+public:
+    explicit TokenStream(Lexer& lexer) : TokenStream(&lexer, nullptr, lexer.scanToken()) {}
+    explicit TokenStream(const std::vector<Token>& tokens, size_t start = 0)
+        : TokenStream(nullptr, tokens.data(), tokens[start]) {
+        position = start;
+    }
+
+    // The current token; END_OF_FILE once the input is exhausted.
+    const Token& peek() const { return array ? array[position] : ring[position % Window]; }
+
+    // The token consumed by the last advance().
+    const Token& previous() const { return array ? array[position - 1] : ring[(position - 1) % Window]; }
+
+    // Number of tokens consumed so far (counting from the array's start).
+    size_t index() const { return position; }
+
+    // Moves to the next token; does nothing at END_OF_FILE.
+    void advance() {
+        if (peek().type == TokenType::END_OF_FILE) return;
+        position++;
+        if (!array) ring[position % Window] = lexer->scanToken();
+    }
+
+private:
+    // The parser looks at the current and the previous token only.
+    static constexpr size_t Window = 4;
+
+    TokenStream(Lexer* lexer, const Token* array, Token first)
+        : lexer(lexer), array(array), ring{first, first, first, first} {}
+
+    Lexer* lexer;
+    const Token* array;
+    size_t position = 0;
+    Token ring[Window];
+};
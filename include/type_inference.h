@@ -0,0 +1,139 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string_view>
+#include <vector>
+#include "ast.h"
+#include "interner.h"
+
+// "int", "double", ...: how error messages and specialized function names
+// spell a type.
+const char* typeName(ValueType type);
+
+// Gives every expression, variable and function a static type (int, double,
+// bool or string) so the code generator can emit typed allocas, loads and
+// arithmetic instead of treating everything as i32. Runs after the Resolver,
+// whose slots it uses to find a variable's declaration.
+//
+// Types are inferred flow-insensitively: a variable has the join of every
+// value stored in it, and a function the join of the values it returns. The
+// join of int and double is double; any other mix is a type error. Because a
+// call's type depends on the callee's returns, the program is walked again
+// until nothing changes. What is still unknown then (say, a function that
+// returns no value) becomes int.
+//
+// Parameters have no declared types, so over the whole program a function is
+// specialized per call: each distinct list of argument types gets its own
+// signature and its own copy of the body, typed and lowered separately
+// (add(int, int) and add(double, double) are two functions). A function that
+// is never called gets no signature worth lowering. A streamed function has
+// one signature instead: the first statement that calls it types its body
+// from that call's arguments, and every later call must fit those types.
+class TypeInference {
+public:
+    struct Signature {
+        std::vector<ValueType> params;     // of the parameter slots; may be wider than `arguments`
+        std::vector<ValueType> arguments;  // the argument types it was specialized for
+        ValueType result = ValueType::Unknown;
+        Symbol name = NoSymbol;
+        FunctionStmt* function = nullptr;  // the body these types are written into
+        FunctionStmt* deferred = nullptr;  // body not parsed yet
+        uint32_t definition = 0;           // signature of the function as written; its own for that one
+        std::vector<uint32_t> instances;   // of a definition: every specialization made of it, itself first
+        uint64_t round = 0;                // last round the body was walked in
+        bool sealed = false;               // already lowered: types can no longer change
+    };
+
+    // Parses and resolves a deferred function's body.
+    using BodyLoader = std::function<void(FunctionStmt*)>;
+    // Returns a resolved copy of a function, whose types can then differ
+    // from the original's.
+    using Cloner = std::function<FunctionStmt*(const FunctionStmt*)>;
+
+    explicit TypeInference(std::string_view source);
+
+    // Infers the whole program, specializing functions per call. Deferred
+    // functions that are called get their bodies loaded on the way; the ones
+    // still deferred afterwards are never called. Throws on a type error.
+    void infer(const std::vector<Stmt*>& statements, const BodyLoader& load, const Cloner& clone);
+
+    // Infers one top-level statement of a streamed program. Its types are
+    // final once this returns, since the statement is lowered next: calls
+    // and assignments in later statements must fit them (an int may still
+    // go where a double is expected). A function definition is only
+    // registered; its body is typed by the first statement that calls it,
+    // and listed in typedFunctions() after that statement.
+    void infer(Stmt* stmt);
+
+    // Signatures whose bodies the last infer(Stmt*) typed, in the order it
+    // reached them. They are final and have to be lowered with it.
+    const std::vector<uint32_t>& typedFunctions() const { return walked; }
+
+    const Signature& signature(uint32_t index) const { return signatures[index]; }
+
+    // The signatures to lower for a function definition (by its
+    // FunctionStmt::signature): those the program calls, in the order they
+    // were made. Empty if it is never called.
+    std::vector<uint32_t> specializations(uint32_t definition) const;
+
+private:
+    static constexpr uint32_t NoFunction = UINT32_MAX;
+
+    // Work list, as in the Resolver. Expression tasks run after their
+    // operands, whose types are already set.
+    struct Task {
+        enum Kind : uint8_t {
+            VisitStmt, VisitExpr,
+            Declare, Return, EndFunction,  // after the initializer, value, body
+            Binary, Unary, Call, Assign, Grouping,
+        } kind;
+        Stmt* stmt = nullptr;
+        Expr* expr = nullptr;
+        size_t frame = 0;           // EndFunction: the caller's frame
+        uint32_t function = 0;      // EndFunction: the caller's signature
+    };
+
+    // Where a slot's type lives: a VarStmt's `type` or a parameter of a
+    // signature. Null once the declaration has been lowered (streaming).
+    struct Slot {
+        ValueType type = ValueType::Unknown;
+        ValueType* owner = nullptr;
+    };
+
+    bool round(Stmt* const* statements, size_t count);  // one walk; true if a type changed
+    void run();
+    void visitStmt(Stmt* stmt);
+    void visitExpr(Expr* expr);
+    void define(FunctionStmt* stmt);
+    void walk(uint32_t index);
+    void call(CallExpr* expr);
+    uint32_t specialize(uint32_t definition);  // for the types in `arguments`
+    uint32_t lookup(Symbol symbol) const;
+    void binary(BinaryExpr* expr);
+    void store(Slot& slot, ValueType type, Symbol name);
+    void widen(ValueType& target, ValueType type, bool sealed, Symbol name);
+    void seal();
+    Slot& slot(uint32_t index) {
+        if (frame + index >= slots.size()) slots.resize(frame + index + 1);
+        return slots[frame + index];
+    }
+
+    std::string_view source;
+    Interner& interner;
+    std::deque<Signature> signatures;  // by FunctionStmt::signature and CallExpr::signature; never moves
+    std::vector<uint32_t> functions;   // signature of the first definition, by symbol
+    std::vector<Slot> slots;
+    size_t frame = 0;
+    uint32_t function = NoFunction;    // whose body is being walked
+    std::vector<Task> tasks;
+    const BodyLoader* load = nullptr;
+    const Cloner* clone = nullptr;     // set while specializing
+    std::vector<ValueType> arguments;  // of the call being typed
+    uint64_t rounds = 0;
+    bool changed = false;
+    bool settling = false;  // unknown types become int
+    std::vector<uint32_t> walked;    // streamed: signatures first typed by the current statement
+    std::vector<uint32_t> unsealed;  // top-level slots declared since the last seal()
+};
@@ -0,0 +1,49 @@
+#include "../include/arena.h"
+#include <algorithm>
+#include <stdexcept>
+
+void* Arena::allocateSlow(size_t size, size_t align) {
+    if (align > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+        throw std::runtime_error("Arena: unsupported alignment");
+    }
+    // Oversized requests get a block of their own so the current block keeps
+    // serving small nodes.
+    size_t bytes = std::max(size, blockSize);
+    blocks.emplace_back(new char[bytes]);
+    char* block = blocks.back().get();
+    if (size >= blockSize && blockStart) {
+        used += size;
+        return block;
+    }
+    used += static_cast<size_t>(cursor - blockStart);
+    blockStart = block;
+    cursor = block + size;
+    limit = block + bytes;
+    return block;
+}
+
+void Arena::reset() {
+    blocks.clear();
+    blockStart = cursor = limit = nullptr;
+    used = 0;
+}
+
+void Arena::rewind() {
+    if (!blockStart) return;
+    for (auto& block : blocks) {
+        if (block.get() == blockStart) {
+            std::unique_ptr<char[]> current = std::move(block);
+            blocks.clear();
+            blocks.push_back(std::move(current));
+            break;
+        }
+    }
+    cursor = blockStart;
+    used = 0;
+}
+
+void Arena::adopt(Arena& other) {
+    used += other.bytesUsed();
+    for (auto& block : other.blocks) blocks.push_back(std::move(block));
+    other.reset();
+}
@@ -0,0 +1,178 @@
+#include "../include/ast.h"
+#include <initializer_list>
+#include <vector>
+
+namespace {
+
+// One pending piece of output: literal text, or a node still to expand.
+struct Piece {
+    enum Kind : uint8_t { Text, ExprNode, StmtNode } kind;
+    std::string_view text;
+    const Expr* expr = nullptr;
+    const Stmt* stmt = nullptr;
+
+    Piece(const char* text) : kind(Text), text(text) {}
+    Piece(std::string_view text) : kind(Text), text(text) {}
+    Piece(const Expr* expr) : kind(ExprNode), expr(expr) {}
+    Piece(const Stmt* stmt) : kind(StmtNode), stmt(stmt) {}
+};
+
+// Expanding a node pushes its pieces (children included) in reverse, so
+// they pop off the stack in print order. A missing child prints as "null".
+class Printer {
+public:
+    Printer(std::string_view source, std::string& out) : source(source), out(out) {}
+
+    void print(Piece root) {
+        stack.push_back(root);
+        while (!stack.empty()) {
+            Piece piece = stack.back();
+            stack.pop_back();
+            switch (piece.kind) {
+                case Piece::Text: out += piece.text; break;
+                case Piece::ExprNode: expand(piece.expr); break;
+                case Piece::StmtNode: expand(piece.stmt); break;
+            }
+        }
+    }
+
+private:
+    void emit(std::initializer_list<Piece> pieces) {
+        for (auto it = pieces.end(); it != pieces.begin();) stack.push_back(*--it);
+    }
+
+    // Pushes `items` as "item, item, " in order.
+    template <typename T>
+    void emitList(const ArenaList<T>& items) {
+        for (size_t i = items.size(); i-- > 0;) emit({items[i], ", "});
+    }
+
+    void expand(const Expr* expr) {
+        if (!expr) {
+            out += "null";
+            return;
+        }
+        switch (expr->kind) {
+            case ExprKind::Binary: {
+                auto binary = static_cast<const BinaryExpr*>(expr);
+                emit({"BinaryExpr(", binary->left, ", ", binary->op.text(source), ", ", binary->right, ")"});
+                break;
+            }
+            case ExprKind::Unary: {
+                auto unary = static_cast<const UnaryExpr*>(expr);
+                emit({"UnaryExpr(", unary->op.text(source), ", ", unary->right, ")"});
+                break;
+            }
+            case ExprKind::Literal:
+                emit({"LiteralExpr(", static_cast<const LiteralExpr*>(expr)->value.text(source), ")"});
+                break;
+            case ExprKind::Variable:
+                emit({"VariableExpr(", static_cast<const VariableExpr*>(expr)->name.text(source), ")"});
+                break;
+            case ExprKind::Assign: {
+                auto assign = static_cast<const AssignExpr*>(expr);
+                emit({"AssignExpr(", assign->name.text(source), ", ", assign->value, ")"});
+                break;
+            }
+            case ExprKind::Call: {
+                auto call = static_cast<const CallExpr*>(expr);
+                emit({"])"});
+                emitList(call->arguments);
+                emit({"CallExpr(", call->callee.text(source), ", ["});
+                break;
+            }
+            case ExprKind::Grouping:
+                emit({"GroupingExpr(", static_cast<const GroupingExpr*>(expr)->expression, ")"});
+                break;
+        }
+    }
+
+    void expand(const Stmt* stmt) {
+        if (!stmt) {
+            out += "null";
+            return;
+        }
+        switch (stmt->kind) {
+            case StmtKind::Expression:
+                emit({"ExprStmt(", static_cast<const ExprStmt*>(stmt)->expression, ")"});
+                break;
+            case StmtKind::Print:
+                emit({"PrintStmt(", static_cast<const PrintStmt*>(stmt)->expression, ")"});
+                break;
+            case StmtKind::Var: {
+                auto varStmt = static_cast<const VarStmt*>(stmt);
+                emit({varStmt->constant ? "ConstStmt(" : "VarStmt(", varStmt->name.text(source), ", ",
+                      varStmt->initializer, ")"});
+                break;
+            }
+            case StmtKind::Block: {
+                auto blockStmt = static_cast<const BlockStmt*>(stmt);
+                emit({"])"});
+                emitList(blockStmt->statements);
+                emit({"BlockStmt(["});
+                break;
+            }
+            case StmtKind::If: {
+                auto ifStmt = static_cast<const IfStmt*>(stmt);
+                emit({"IfStmt(", ifStmt->condition, ", ", ifStmt->thenBranch, ", ", ifStmt->elseBranch, ")"});
+                break;
+            }
+            case StmtKind::While: {
+                auto whileStmt = static_cast<const WhileStmt*>(stmt);
+                Piece condition = whileStmt->condition ? Piece(whileStmt->condition) : Piece("true");
+                emit({"WhileStmt(", condition, ", ", whileStmt->body, ")"});
+                break;
+            }
+            case StmtKind::For: {
+                auto forStmt = static_cast<const ForStmt*>(stmt);
+                emit({"ForStmt(", forStmt->initializer, ", ", forStmt->condition, ", ", forStmt->increment, ", ",
+                      forStmt->body, ")"});
+                break;
+            }
+            case StmtKind::Function: {
+                auto function = static_cast<const FunctionStmt*>(stmt);
+                if (function->deferred) {
+                    emit({"], <deferred>)"});
+                } else {
+                    emit({"])"});
+                    emitList(function->body);
+                    emit({"], ["});
+                }
+                for (size_t i = function->params.size(); i-- > 0;) emit({function->params[i].text(source), ", "});
+                emit({"FunctionStmt(", function->name.text(source), ", ["});
+                break;
+            }
+            case StmtKind::Return: {
+                auto returnStmt = static_cast<const ReturnStmt*>(stmt);
+                emit({"ReturnStmt(", returnStmt->keyword.text(source), ", ", returnStmt->value, ")"});
+                break;
+            }
+        }
+    }
+
+    std::string_view source;
+    std::string& out;
+    std::vector<Piece> stack;
+};
+
+} // namespace
+
+void printAst(const Stmt* stmt, std::string_view source, std::string& out) {
+    Printer(source, out).print(stmt);
+}
+
+void printAst(const Expr* expr, std::string_view source, std::string& out) {
+    Printer(source, out).print(expr);
+}
+
+std::string Expr::toString(std::string_view source) const {
+    std::string out;
+    printAst(this, source, out);
+    return out;
+}
+
+std::string Stmt::toString(std::string_view source) const {
+    std::string out;
+    printAst(this, source, out);
+    return out;
+}
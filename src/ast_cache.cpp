@@ -0,0 +1,274 @@
+#include "../include/ast_cache.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../include/flat_ast.h"
+
+namespace {
+
+constexpr char cacheMagic[8] = {'G', 'R', 'A', 'N', 'A', 'S', 'T', '\0'};
+constexpr uint32_t formatVersion = 3;
+
+// Entry layout: this header, then tokens, a, b, c, lists, roots and kinds,
+// back to back. Every array after the header keeps its natural alignment
+// because the 4-byte arrays follow the 16-byte tokens and kinds come last.
+struct CacheHeader {
+    char magic[8];
+    uint32_t format;
+    uint32_t tokenSize;
+    uint64_t key;         // hashSource(source) mixed with the compiler version
+    uint64_t sourceSize;
+    uint64_t nodeCount;
+    uint64_t listCount;
+    uint64_t rootCount;
+    uint64_t payloadHash;  // hashSource() of everything after the header
+};
+
+static_assert(sizeof(CacheHeader) == 64, "cache header layout is part of the format");
+
+uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t cacheKey(std::string_view source) {
+    return mix(hashSource(source) ^ hashSource(GRAN_VERSION));
+}
+
+size_t entrySize(uint64_t nodes, uint64_t lists, uint64_t roots) {
+    return sizeof(CacheHeader) + nodes * (sizeof(Token) + 3 * sizeof(NodeId) + sizeof(NodeKind)) +
+           (lists + roots) * sizeof(NodeId);
+}
+
+template <typename T>
+const T* takeArray(const char*& cursor, size_t count) {
+    const T* array = reinterpret_cast<const T*>(cursor);
+    cursor += count * sizeof(T);
+    return array;
+}
+
+// Read-only mapping of a whole cache entry; unmapped on destruction.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return;
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void* addr = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                data = static_cast<const char*>(addr);
+                size = static_cast<size_t>(st.st_size);
+            }
+        }
+        ::close(fd);
+    }
+    ~MappedFile() {
+        if (data) ::munmap(const_cast<char*>(data), size);
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data = nullptr;
+    size_t size = 0;
+};
+
+} // namespace
+
+uint64_t hashSource(std::string_view source) {
+    constexpr uint64_t prime1 = 0x9e3779b185ebca87ULL;
+    constexpr uint64_t prime2 = 0xc2b2ae3d27d4eb4fULL;
+    auto round = [](uint64_t lane, uint64_t word) {
+        lane += word * prime2;
+        lane = (lane << 31) | (lane >> 33);
+        return lane * prime1;
+    };
+    const char* p = source.data();
+    size_t n = source.size();
+    // Four independent lanes over 32-byte stripes keep the multiplier busy.
+    uint64_t lanes[4] = {prime1 + prime2, prime2, 0, 0 - prime1};
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        for (int k = 0; k < 4; k++) {
+            uint64_t word;
+            std::memcpy(&word, p + i + 8 * k, sizeof(word));
+            lanes[k] = round(lanes[k], word);
+        }
+    }
+    uint64_t h = mix(n);
+    for (uint64_t lane : lanes) h = mix(h ^ lane) * prime1;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, p + i, sizeof(word));
+        h = round(h, word);
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, p + i, n - i);
+    return mix(h ^ round(n - i, tail));
+}
+
+AstCache::AstCache(std::string directory, uint64_t maxBytes) : directory(std::move(directory)), maxBytes(maxBytes) {}
+
+AstCache AstCache::fromEnvironment() {
+    const char* toggle = std::getenv("GRAN_CACHE");
+    if (toggle && std::strcmp(toggle, "0") == 0) return AstCache("");
+    uint64_t maxBytes = DefaultMaxBytes;
+    if (const char* limit = std::getenv("GRAN_CACHE_MAX_MB"); limit && *limit) {
+        maxBytes = std::strtoull(limit, nullptr, 10) << 20;
+    }
+    if (const char* dir = std::getenv("GRAN_CACHE_DIR"); dir && *dir) return AstCache(dir, maxBytes);
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+        return AstCache(std::string(xdg) + "/gran", maxBytes);
+    }
+    if (const char* home = std::getenv("HOME"); home && *home) {
+        return AstCache(std::string(home) + "/.cache/gran", maxBytes);
+    }
+    return AstCache("");
+}
+
+std::string AstCache::entryPath(std::string_view source) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.ast", static_cast<unsigned long long>(cacheKey(source)));
+    return directory + "/" + name;
+}
+
+std::optional<std::vector<Stmt*>> AstCache::load(std::string_view source, Arena& arena) const {
+    if (!enabled()) return std::nullopt;
+    std::string path = entryPath(source);
+    MappedFile file(path);
+    if (file.size < sizeof(CacheHeader)) return std::nullopt;
+
+    CacheHeader header;
+    std::memcpy(&header, file.data, sizeof(header));
+    if (std::memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 || header.format != formatVersion ||
+        header.tokenSize != sizeof(Token) || header.key != cacheKey(source) || header.sourceSize != source.size()) {
+        return std::nullopt;
+    }
+    // Counts are bounded by the file size before they are multiplied out.
+    if (header.nodeCount > file.size || header.listCount > file.size || header.rootCount > file.size ||
+        entrySize(header.nodeCount, header.listCount, header.rootCount) != file.size) {
+        return std::nullopt;
+    }
+    // unflatten() only checks the shape of the tree; a flipped bit in a
+    // token or a child index could still give a valid, different program.
+    std::string_view payload(file.data + sizeof(CacheHeader), file.size - sizeof(CacheHeader));
+    if (hashSource(payload) != header.payloadHash) return std::nullopt;
+
+    const char* cursor = file.data + sizeof(CacheHeader);
+    FlatAstView view;
+    view.nodeCount = header.nodeCount;
+    view.listCount = header.listCount;
+    view.rootCount = header.rootCount;
+    view.tokens = takeArray<Token>(cursor, view.nodeCount);
+    view.a = takeArray<NodeId>(cursor, view.nodeCount);
+    view.b = takeArray<NodeId>(cursor, view.nodeCount);
+    view.c = takeArray<NodeId>(cursor, view.nodeCount);
+    view.lists = takeArray<NodeId>(cursor, view.listCount);
+    view.roots = takeArray<NodeId>(cursor, view.rootCount);
+    view.kinds = takeArray<NodeKind>(cursor, view.nodeCount);
+
+    try {
+        std::vector<Stmt*> statements = unflatten(view, source, arena);
+        ::utimensat(AT_FDCWD, path.c_str(), nullptr, 0);  // recently used: evicted last
+        return statements;
+    } catch (const std::runtime_error&) {
+        return std::nullopt;
+    }
+}
+
+bool AstCache::store(std::string_view source, const std::vector<Stmt*>& statements) const {
+    if (!enabled()) return false;
+    FlatAst ast = flatten(statements);
+
+    CacheHeader header = {};
+    std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.format = formatVersion;
+    header.tokenSize = sizeof(Token);
+    header.key = cacheKey(source);
+    header.sourceSize = source.size();
+    header.nodeCount = ast.kinds.size();
+    header.listCount = ast.lists.size();
+    header.rootCount = ast.roots.size();
+
+    // The payload is assembled first, as the header carries its hash
+    std::string payload;
+    payload.reserve(entrySize(header.nodeCount, header.listCount, header.rootCount) - sizeof(CacheHeader));
+    auto put = [&](const auto& array) {
+        payload.append(reinterpret_cast<const char*>(array.data()), array.size() * sizeof(array[0]));
+    };
+    put(ast.tokens);
+    put(ast.a);
+    put(ast.b);
+    put(ast.c);
+    put(ast.lists);
+    put(ast.roots);
+    put(ast.kinds);
+    header.payloadHash = hashSource(payload);
+
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error) return false;
+
+    // Write under a private name and rename into place, so a concurrent run
+    // never maps a half-written entry.
+    std::string path = entryPath(source);
+    std::string temp = path + "." + std::to_string(::getpid()) + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+        if (!out.flush()) {
+            out.close();
+            std::remove(temp.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::remove(temp.c_str());
+        return false;
+    }
+    evict();
+    return true;
+}
+
+// Deletes the least recently used entries until the rest fit in maxBytes;
+// an entry larger than that on its own goes too. Failures are ignored, as
+// another run may be evicting at the same time.
+void AstCache::evict() const {
+    struct Entry {
+        std::filesystem::path path;
+        std::filesystem::file_time_type used;
+        uint64_t size;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    std::error_code error;
+    for (const auto& file : std::filesystem::directory_iterator(directory, error)) {
+        if (file.path().extension() != ".ast" || !file.is_regular_file(error)) continue;
+        uint64_t size = file.file_size(error);
+        if (error) continue;
+        auto used = file.last_write_time(error);
+        if (error) continue;
+        entries.push_back({file.path(), used, size});
+        total += size;
+    }
+    if (total <= maxBytes) return;
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+    for (const Entry& entry : entries) {
+        if (total <= maxBytes) break;
+        if (std::filesystem::remove(entry.path, error)) total -= entry.size;
+    }
+}
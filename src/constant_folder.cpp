@@ -0,0 +1,349 @@
+#include "../include/constant_folder.h"
+#include <stdexcept>
+#include <string>
+
+Stmt* ConstantFolder::fold(Stmt* stmt) {
+    tasks.push_back({Task::VisitStmt, stmt});
+    run();
+    return popStmt().stmt;
+}
+
+// Its slots are numbered from 0 again.
+void ConstantFolder::foldFunction(FunctionStmt* function) {
+    tasks.push_back({Task::Function, function, nullptr, frame});
+    frame = constants.size();
+    for (size_t i = function->body.size(); i-- > 0;) tasks.push_back({Task::VisitStmt, function->body[i]});
+    run();
+    popStmt();
+}
+
+void ConstantFolder::run() {
+    while (!tasks.empty()) {
+        Task task = tasks.back();
+        tasks.pop_back();
+        switch (task.kind) {
+            case Task::VisitStmt: visitStmt(task.stmt); break;
+            case Task::VisitExpr: visitExpr(task.expr); break;
+            case Task::Discard:
+            case Task::Print:
+            case Task::Var:
+            case Task::Block:
+            case Task::Branch:
+            case Task::Loop:
+            case Task::ForLoop:
+            case Task::Function:
+            case Task::Return:
+                stmts.push_back(finish(task));
+                break;
+            case Task::Binary:
+            case Task::Unary:
+            case Task::Grouping:
+            case Task::Assign:
+            case Task::Call:
+                exprs.push_back(finishExpr(task));
+                break;
+        }
+    }
+}
+
+// Pushes the epilogue first and the children after it, so the children
+// are finished (in source order) by the time the epilogue runs.
+void ConstantFolder::visitStmt(Stmt* stmt) {
+    auto push = [this](Task::Kind kind, Stmt* s) { tasks.push_back({kind, s}); };
+    auto expr = [this](Expr* e) { if (e) tasks.push_back({Task::VisitExpr, nullptr, e}); };
+
+    if (!stmt) {
+        stmts.push_back({nullptr, false});
+        return;
+    }
+    switch (stmt->kind) {
+        case StmtKind::Expression:
+            push(Task::Discard, stmt);
+            expr(static_cast<ExprStmt*>(stmt)->expression);
+            break;
+        case StmtKind::Print:
+            push(Task::Print, stmt);
+            expr(static_cast<PrintStmt*>(stmt)->expression);
+            break;
+        case StmtKind::Var:
+            push(Task::Var, stmt);
+            expr(static_cast<VarStmt*>(stmt)->initializer);
+            break;
+        case StmtKind::Block: {
+            auto blockStmt = static_cast<BlockStmt*>(stmt);
+            push(Task::Block, stmt);
+            for (size_t i = blockStmt->statements.size(); i-- > 0;) push(Task::VisitStmt, blockStmt->statements[i]);
+            break;
+        }
+        case StmtKind::If: {
+            auto ifStmt = static_cast<IfStmt*>(stmt);
+            push(Task::Branch, stmt);
+            push(Task::VisitStmt, ifStmt->elseBranch);
+            push(Task::VisitStmt, ifStmt->thenBranch);
+            expr(ifStmt->condition);
+            break;
+        }
+        case StmtKind::While: {
+            auto whileStmt = static_cast<WhileStmt*>(stmt);
+            push(Task::Loop, stmt);
+            push(Task::VisitStmt, whileStmt->body);
+            expr(whileStmt->condition);
+            break;
+        }
+        case StmtKind::For: {
+            auto forStmt = static_cast<ForStmt*>(stmt);
+            push(Task::ForLoop, stmt);
+            push(Task::VisitStmt, forStmt->body);
+            expr(forStmt->increment);
+            expr(forStmt->condition);
+            push(Task::VisitStmt, forStmt->initializer);
+            break;
+        }
+        case StmtKind::Function:
+            // Folded on its own when it is lowered, once its types are known
+            stmts.push_back({stmt, false});
+            break;
+        case StmtKind::Return:
+            push(Task::Return, stmt);
+            expr(static_cast<ReturnStmt*>(stmt)->value);
+            break;
+    }
+}
+
+void ConstantFolder::visitExpr(Expr* expr) {
+    auto push = [this](Task::Kind kind, Expr* e) { tasks.push_back({kind, nullptr, e}); };
+
+    switch (expr->kind) {
+        case ExprKind::Binary: {
+            auto binary = static_cast<BinaryExpr*>(expr);
+            push(Task::Binary, expr);
+            push(Task::VisitExpr, binary->right);
+            push(Task::VisitExpr, binary->left);
+            break;
+        }
+        case ExprKind::Unary:
+            push(Task::Unary, expr);
+            push(Task::VisitExpr, static_cast<UnaryExpr*>(expr)->right);
+            break;
+        case ExprKind::Grouping:
+            push(Task::Grouping, expr);
+            push(Task::VisitExpr, static_cast<GroupingExpr*>(expr)->expression);
+            break;
+        case ExprKind::Assign:
+            push(Task::Assign, expr);
+            push(Task::VisitExpr, static_cast<AssignExpr*>(expr)->value);
+            break;
+        case ExprKind::Call: {
+            auto call = static_cast<CallExpr*>(expr);
+            push(Task::Call, expr);
+            for (size_t i = call->arguments.size(); i-- > 0;) push(Task::VisitExpr, call->arguments[i]);
+            break;
+        }
+        case ExprKind::Literal:
+            exprs.push_back(expr);
+            break;
+        case ExprKind::Variable: {
+            auto variable = static_cast<VariableExpr*>(expr);
+            size_t index = frame + variable->slot;
+            if (index < constants.size() && constants[index].known) {
+                const Constant& constant = constants[index];
+                LiteralExpr* copy = arena.make<LiteralExpr>(constant.token);
+                copy->type = variable->type;
+                copy->folded = constant.folded;
+                copy->constant = constant.value;
+                exprs.push_back(copy);
+            } else {
+                exprs.push_back(expr);
+            }
+            break;
+        }
+    }
+}
+
+ConstantFolder::Result ConstantFolder::finish(const Task& task) {
+    double value;
+    switch (task.kind) {
+        case Task::Discard: {
+            auto exprStmt = static_cast<ExprStmt*>(task.stmt);
+            exprStmt->expression = popExpr();
+            // A literal on its own does nothing
+            if (exprStmt->expression->kind == ExprKind::Literal) return {nullptr, false};
+            return {task.stmt, false};
+        }
+        case Task::Print: {
+            auto printStmt = static_cast<PrintStmt*>(task.stmt);
+            printStmt->expression = popExpr();
+            return {task.stmt, false};
+        }
+        case Task::Var: {
+            auto varStmt = static_cast<VarStmt*>(task.stmt);
+            if (varStmt->initializer) varStmt->initializer = popExpr();
+            size_t index = frame + varStmt->slot;
+            if (index >= constants.size()) constants.resize(index + 1);
+            constants[index].known = false;  // the slot may have held another variable's constant
+            if (!varStmt->constant) return {task.stmt, false};
+
+            if (varStmt->initializer->kind != ExprKind::Literal) {
+                throw std::runtime_error("Initializer of const " + std::string(varStmt->name.text(source)) +
+                                         " is not a compile-time constant");
+            }
+            auto literal = static_cast<LiteralExpr*>(varStmt->initializer);
+            constants[index] = {true, literal->folded, literal->constant, literal->value};
+            return {nullptr, false};
+        }
+        case Task::Block: {
+            auto blockStmt = static_cast<BlockStmt*>(task.stmt);
+            bool exits = takeList(blockStmt->statements);
+            if (blockStmt->statements.empty()) return {nullptr, false};
+            return {task.stmt, exits};
+        }
+        case Task::Branch: {
+            auto ifStmt = static_cast<IfStmt*>(task.stmt);
+            Result elseBranch = popStmt();
+            Result thenBranch = popStmt();
+            ifStmt->condition = popExpr();
+            if (constant(ifStmt->condition, value)) {
+                return value != 0 ? thenBranch : elseBranch;
+            }
+            ifStmt->thenBranch = thenBranch.stmt;
+            ifStmt->elseBranch = elseBranch.stmt;
+            return {task.stmt, thenBranch.exits && elseBranch.exits};
+        }
+        case Task::Loop: {
+            auto whileStmt = static_cast<WhileStmt*>(task.stmt);
+            whileStmt->body = popStmt().stmt;
+            if (whileStmt->condition) {
+                whileStmt->condition = popExpr();
+                if (constant(whileStmt->condition, value)) {
+                    if (value == 0) return {nullptr, false};
+                    whileStmt->condition = nullptr;
+                }
+            }
+            return {task.stmt, whileStmt->condition == nullptr};
+        }
+        case Task::ForLoop: {
+            auto forStmt = static_cast<ForStmt*>(task.stmt);
+            forStmt->body = popStmt().stmt;
+            if (forStmt->increment) forStmt->increment = popExpr();
+            if (forStmt->condition) forStmt->condition = popExpr();
+            Result initializer = popStmt();
+            forStmt->initializer = initializer.stmt;
+            if (forStmt->condition && constant(forStmt->condition, value)) {
+                if (value == 0) return initializer;
+                forStmt->condition = nullptr;
+            }
+            return {task.stmt, initializer.exits || forStmt->condition == nullptr};
+        }
+        case Task::Function: {
+            auto funcStmt = static_cast<FunctionStmt*>(task.stmt);
+            takeList(funcStmt->body);
+            constants.resize(frame);
+            frame = task.frame;
+            return {task.stmt, false};
+        }
+        case Task::Return: {
+            auto returnStmt = static_cast<ReturnStmt*>(task.stmt);
+            if (returnStmt->value) returnStmt->value = popExpr();
+            return {task.stmt, true};
+        }
+        default:
+            break;
+    }
+    return {task.stmt, false};
+}
+
+Expr* ConstantFolder::finishExpr(const Task& task) {
+    switch (task.kind) {
+        case Task::Binary: {
+            auto binaryExpr = static_cast<BinaryExpr*>(task.expr);
+            binaryExpr->right = popExpr();
+            binaryExpr->left = popExpr();
+            return binary(binaryExpr);
+        }
+        case Task::Unary: {
+            auto unaryExpr = static_cast<UnaryExpr*>(task.expr);
+            unaryExpr->right = popExpr();
+            return unary(unaryExpr);
+        }
+        case Task::Grouping: {
+            auto grouping = static_cast<GroupingExpr*>(task.expr);
+            grouping->expression = popExpr();
+            // Parentheses around a literal are dropped
+            if (grouping->expression->kind == ExprKind::Literal) return grouping->expression;
+            return task.expr;
+        }
+        case Task::Assign: {
+            auto assign = static_cast<AssignExpr*>(task.expr);
+            assign->value = popExpr();
+            return task.expr;
+        }
+        case Task::Call: {
+            auto callExpr = static_cast<CallExpr*>(task.expr);
+            for (size_t i = callExpr->arguments.size(); i-- > 0;) callExpr->arguments[i] = popExpr();
+            return call(callExpr);
+        }
+        default:
+            break;
+    }
+    return task.expr;
+}
+
+// Collects the folded children of `list` (the last list.size() results on
+// `stmts`) back into it, leaving out removed ones and everything after a
+// child that exits.
+bool ConstantFolder::takeList(ArenaList<Stmt*>& list) {
+    size_t base = stmts.size() - list.size();
+    size_t kept = 0;
+    bool exits = false;
+    for (size_t i = base; i < stmts.size() && !exits; i++) {
+        if (!stmts[i].stmt) continue;
+        list[kept++] = stmts[i].stmt;
+        exits = stmts[i].exits;
+    }
+    stmts.resize(base);
+    list.count = kept;
+    return exits;
+}
+
+Expr* ConstantFolder::binary(BinaryExpr* expr) {
+    double left, right, value;
+    if (!constant(expr->left, left) || !constant(expr->right, right) ||
+        !Evaluator::binary(expr, source, left, right, value)) {
+        return expr;
+    }
+    return literal(expr->op, expr->type, value);
+}
+
+Expr* ConstantFolder::unary(UnaryExpr* expr) {
+    double operand, value;
+    if (!constant(expr->right, operand) || !Evaluator::unary(expr, source, operand, value)) return expr;
+    return literal(expr->op, expr->type, value);
+}
+
+// Runs a call on literal arguments at compile time. Strings cannot be
+// folded into a literal, so calls returning one are left alone.
+Expr* ConstantFolder::call(CallExpr* expr) {
+    if (expr->type == ValueType::String) return expr;
+    arguments.clear();
+    for (Expr* argument : expr->arguments) {
+        double value;
+        if (!constant(argument, value)) return expr;
+        arguments.push_back(value);
+    }
+    double result;
+    if (!evaluator.evaluate(expr, arguments, result)) return expr;
+    return literal(expr->callee, expr->type, result);
+}
+
+// Value of a number or bool literal; strings are never folded.
+bool ConstantFolder::constant(const Expr* expr, double& value) const {
+    return expr->kind == ExprKind::Literal && Evaluator::literal(static_cast<const LiteralExpr*>(expr), source, value);
+}
+
+LiteralExpr* ConstantFolder::literal(Token token, ValueType type, double value) {
+    LiteralExpr* result = arena.make<LiteralExpr>(token);
+    result->type = type;
+    result->folded = true;
+    result->constant = value;
+    return result;
+}
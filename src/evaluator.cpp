@@ -0,0 +1,304 @@
+#include "../include/evaluator.h"
+#include <cstring>
+#include <string>
+
+namespace {
+
+// i32 arithmetic as LLVM does it: two's complement, wrapping on overflow.
+int32_t wrap(int64_t value) { return static_cast<int32_t>(static_cast<uint32_t>(value)); }
+
+}  // namespace
+
+// Looks the call up among those evaluated before, and runs it if it is new.
+bool Evaluator::evaluate(const CallExpr* expr, const std::vector<double>& arguments, double& result) {
+    uint32_t signature = expr->signature;
+    if (signature == UINT32_MAX) return false;
+    if (signature < unevaluable.size() && unevaluable[signature]) return false;
+
+    Key key{signature};
+    for (double argument : arguments) {
+        uint64_t bits;
+        std::memcpy(&bits, &argument, sizeof bits);
+        key.push_back(bits);
+    }
+    auto found = outcomes.find(key);
+    if (found == outcomes.end()) {
+        tasks.clear();
+        slots.clear();
+        frames.clear();
+        values = arguments;
+        failure = Failure::None;
+        bool evaluated = call(expr) && run();
+        found = outcomes.emplace(std::move(key), Outcome{evaluated, evaluated ? values.back() : 0}).first;
+        if (failure == Failure::Unsupported || failure == Failure::OutOfSteps) {
+            if (signature >= unevaluable.size()) unevaluable.resize(signature + 1);
+            unevaluable[signature] = true;
+        }
+    }
+    result = found->second.result;
+    return found->second.evaluated;
+}
+
+bool Evaluator::run() {
+    for (size_t steps = 0; !tasks.empty(); steps++) {
+        if (steps == StepBudget) return fail(Failure::OutOfSteps);
+        Task task = tasks.back();
+        tasks.pop_back();
+        switch (task.kind) {
+            case Task::Exec:
+                if (!exec(task.stmt)) return false;
+                break;
+            case Task::Eval:
+                if (!eval(task.expr)) return false;
+                break;
+            case Task::Discard: pop(); break;
+            case Task::Declare: {
+                auto varStmt = static_cast<const VarStmt*>(task.stmt);
+                slot(varStmt->slot) = varStmt->initializer ? pop() : 0;
+                break;
+            }
+            case Task::Branch: {
+                auto ifStmt = static_cast<const IfStmt*>(task.stmt);
+                tasks.push_back({Task::Exec, pop() != 0 ? ifStmt->thenBranch : ifStmt->elseBranch});
+                break;
+            }
+            case Task::Loop: {
+                // Runs the body, then the test again
+                auto whileStmt = static_cast<const WhileStmt*>(task.stmt);
+                if (whileStmt->condition && pop() == 0) break;
+                tasks.push_back(task);
+                if (whileStmt->condition) tasks.push_back({Task::Eval, nullptr, whileStmt->condition});
+                tasks.push_back({Task::Exec, whileStmt->body});
+                break;
+            }
+            case Task::ForLoop: {
+                auto forStmt = static_cast<const ForStmt*>(task.stmt);
+                if (forStmt->condition && pop() == 0) break;
+                tasks.push_back(task);
+                if (forStmt->condition) tasks.push_back({Task::Eval, nullptr, forStmt->condition});
+                if (forStmt->increment) {
+                    tasks.push_back({Task::Discard});
+                    tasks.push_back({Task::Eval, nullptr, forStmt->increment});
+                }
+                tasks.push_back({Task::Exec, forStmt->body});
+                break;
+            }
+            case Task::Return: {
+                double value = static_cast<const ReturnStmt*>(task.stmt)->value ? pop() : 0;
+                tasks.resize(frames.back().tasks);
+                frames.back().returned = true;
+                values.push_back(value);
+                break;
+            }
+            case Task::EndCall: {
+                Frame frame = frames.back();
+                frames.pop_back();
+                slots.resize(frame.slots);
+                if (!frame.returned) values.push_back(0);
+                break;
+            }
+            case Task::Binary: {
+                double right = pop();
+                double left = pop();
+                double value;
+                if (!binary(static_cast<const BinaryExpr*>(task.expr), source, left, right, value)) {
+                    return fail(Failure::Trap);
+                }
+                values.push_back(value);
+                break;
+            }
+            case Task::Unary: {
+                double value;
+                if (!unary(static_cast<const UnaryExpr*>(task.expr), source, pop(), value)) return fail(Failure::Trap);
+                values.push_back(value);
+                break;
+            }
+            case Task::Assign: {
+                // Stored as computed: an int that goes into a double is already one
+                slot(static_cast<const AssignExpr*>(task.expr)->slot) = values.back();
+                break;
+            }
+            case Task::Call:
+                if (!call(static_cast<const CallExpr*>(task.expr))) return false;
+                break;
+        }
+    }
+    return true;
+}
+
+// Queues a statement; children are pushed last so they run first.
+bool Evaluator::exec(const Stmt* stmt) {
+    auto push = [this](Task::Kind kind, const Stmt* s) { tasks.push_back({kind, s}); };
+    auto expr = [this](const Expr* e) { if (e) tasks.push_back({Task::Eval, nullptr, e}); };
+
+    if (!stmt) return true;
+    switch (stmt->kind) {
+        case StmtKind::Expression:
+            push(Task::Discard, stmt);
+            expr(static_cast<const ExprStmt*>(stmt)->expression);
+            break;
+        case StmtKind::Print:
+            return fail(Failure::Unsupported);
+        case StmtKind::Var:
+            push(Task::Declare, stmt);
+            expr(static_cast<const VarStmt*>(stmt)->initializer);
+            break;
+        case StmtKind::Block: {
+            auto blockStmt = static_cast<const BlockStmt*>(stmt);
+            for (size_t i = blockStmt->statements.size(); i-- > 0;) push(Task::Exec, blockStmt->statements[i]);
+            break;
+        }
+        case StmtKind::If:
+            push(Task::Branch, stmt);
+            expr(static_cast<const IfStmt*>(stmt)->condition);
+            break;
+        case StmtKind::While:
+            push(Task::Loop, stmt);
+            expr(static_cast<const WhileStmt*>(stmt)->condition);
+            break;
+        case StmtKind::For: {
+            auto forStmt = static_cast<const ForStmt*>(stmt);
+            push(Task::ForLoop, stmt);
+            expr(forStmt->condition);
+            push(Task::Exec, forStmt->initializer);
+            break;
+        }
+        case StmtKind::Function:
+            break;  // a definition runs nothing
+        case StmtKind::Return:
+            push(Task::Return, stmt);
+            expr(static_cast<const ReturnStmt*>(stmt)->value);
+            break;
+    }
+    return true;
+}
+
+// Pushes the value of a leaf, or queues an expression after its operands.
+bool Evaluator::eval(const Expr* expr) {
+    auto push = [this](Task::Kind kind, const Expr* e) { tasks.push_back({kind, nullptr, e}); };
+
+    switch (expr->kind) {
+        case ExprKind::Binary: {
+            auto binaryExpr = static_cast<const BinaryExpr*>(expr);
+            push(Task::Binary, expr);
+            push(Task::Eval, binaryExpr->right);
+            push(Task::Eval, binaryExpr->left);
+            break;
+        }
+        case ExprKind::Unary:
+            push(Task::Unary, expr);
+            push(Task::Eval, static_cast<const UnaryExpr*>(expr)->right);
+            break;
+        case ExprKind::Literal: {
+            double value;
+            if (!literal(static_cast<const LiteralExpr*>(expr), source, value)) {
+                return fail(Failure::Unsupported);  // a string
+            }
+            values.push_back(value);
+            break;
+        }
+        case ExprKind::Variable:
+            values.push_back(slot(static_cast<const VariableExpr*>(expr)->slot));
+            break;
+        case ExprKind::Assign:
+            push(Task::Assign, expr);
+            push(Task::Eval, static_cast<const AssignExpr*>(expr)->value);
+            break;
+        case ExprKind::Call: {
+            auto callExpr = static_cast<const CallExpr*>(expr);
+            push(Task::Call, expr);
+            for (size_t i = callExpr->arguments.size(); i-- > 0;) push(Task::Eval, callExpr->arguments[i]);
+            break;
+        }
+        case ExprKind::Grouping:
+            push(Task::Eval, static_cast<const GroupingExpr*>(expr)->expression);
+            break;
+    }
+    return true;
+}
+
+// Enters the callee, whose arguments are the last arguments.size() values:
+// argument i goes to slot i, as in the generated code.
+bool Evaluator::call(const CallExpr* expr) {
+    if (expr->signature == UINT32_MAX) return fail(Failure::Unsupported);
+    const TypeInference::Signature& signature = types.signature(expr->signature);
+    // A sealed (streamed) function may have been freed after it was lowered
+    if (signature.sealed || signature.function->deferred || signature.result == ValueType::String) {
+        return fail(Failure::Unsupported);
+    }
+
+    size_t count = expr->arguments.size();
+    Frame frame{slots.size(), 0, false};
+    slots.insert(slots.end(), values.end() - static_cast<std::ptrdiff_t>(count), values.end());
+    values.resize(values.size() - count);
+    tasks.push_back({Task::EndCall});
+    frame.tasks = tasks.size();
+    frames.push_back(frame);
+    const ArenaList<Stmt*>& body = signature.function->body;
+    for (size_t i = body.size(); i-- > 0;) tasks.push_back({Task::Exec, body[i]});
+    return true;
+}
+
+// Value of a number or bool literal; strings have none.
+bool Evaluator::literal(const LiteralExpr* expr, std::string_view source, double& value) {
+    if (expr->folded) {
+        value = expr->constant;
+        return true;
+    }
+    std::string text(expr->value.text(source));
+    switch (expr->value.type) {
+        case TokenType::INT_LITERAL: value = std::stoi(text); return true;
+        case TokenType::FLOAT_LITERAL: value = std::stod(text); return true;
+        case TokenType::BOOL_LITERAL: value = text == "true"; return true;
+        default: return false;
+    }
+}
+
+bool Evaluator::binary(const BinaryExpr* expr, std::string_view source, double left, double right, double& value) {
+    // Every int and bool is exact as a double, so comparisons need no
+    // separate integer path.
+    std::string_view op = expr->op.text(source);
+    if (expr->op.type == TokenType::COMPARE) {
+        if (op == "<") value = left < right;
+        else if (op == ">") value = left > right;
+        else if (op == "<=") value = left <= right;
+        else if (op == ">=") value = left >= right;
+        else if (op == "==") value = left == right;
+        else if (op == "!=") value = left != right;
+        else return false;
+        return true;
+    }
+
+    if (expr->type == ValueType::Double) {
+        if (op == "+") value = left + right;
+        else if (op == "-") value = left - right;
+        else if (op == "*") value = left * right;
+        else if (op == "/") value = left / right;
+        else return false;
+        return true;
+    }
+
+    auto a = static_cast<int64_t>(left);
+    auto b = static_cast<int64_t>(right);
+    int64_t result;
+    if (op == "+") result = a + b;
+    else if (op == "-") result = a - b;
+    else if (op == "*") result = a * b;
+    else if (op == "/" && b != 0 && !(a == INT32_MIN && b == -1)) result = a / b;
+    else return false;  // including the divisions that trap at run time
+    value = wrap(result);
+    return true;
+}
+
+bool Evaluator::unary(const UnaryExpr* expr, std::string_view source, double operand, double& value) {
+    std::string_view op = expr->op.text(source);
+    if (op == "-") {
+        value = expr->type == ValueType::Double ? -operand : wrap(-static_cast<int64_t>(operand));
+        return true;
+    }
+    if (op == "!") {
+        value = operand == 0;  // logical for numbers too
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,399 @@
+#include "../include/flat_ast.h"
+#include <initializer_list>
+#include <stdexcept>
+
+namespace {
+
+const Token noToken(TokenType::UNKNOWN, 0, 0, 0, 0);
+
+// Walks the pointer tree bottom-up with an explicit stack, so every child
+// gets its id before its parent (in the order a recursive walk would assign
+// them) and deep nesting cannot exhaust the native stack. Each node with
+// children is visited twice: first to queue its second visit and then its
+// children, and again once the children's ids are on `ids`.
+class Flattener : public ExprVisitor, public StmtVisitor {
+public:
+    explicit Flattener(FlatAst& ast) : ast(ast) {}
+
+    NodeId convert(Stmt* root) {
+        push(root);
+        while (!work.empty()) {
+            Work item = work.back();
+            work.pop_back();
+            finishing = item.finish;
+            if (item.expr) {
+                item.expr->accept(this);
+            } else if (item.stmt) {
+                item.stmt->accept(this);
+            } else {
+                ids.push_back(NoNode);
+            }
+        }
+        return take();
+    }
+
+    void visitBinaryExpr(BinaryExpr* expr) override {
+        if (!finishing) return expand(expr, {expr->left, expr->right});
+        NodeId right = take();
+        NodeId left = take();
+        ids.push_back(ast.add(NodeKind::Binary, expr->op, left, right));
+    }
+    void visitUnaryExpr(UnaryExpr* expr) override {
+        if (!finishing) return expand(expr, {expr->right});
+        ids.push_back(ast.add(NodeKind::Unary, expr->op, take()));
+    }
+    void visitLiteralExpr(LiteralExpr* expr) override {
+        ids.push_back(ast.add(NodeKind::Literal, expr->value));
+    }
+    void visitVariableExpr(VariableExpr* expr) override {
+        ids.push_back(ast.add(NodeKind::Variable, expr->name));
+    }
+    void visitAssignExpr(AssignExpr* expr) override {
+        if (!finishing) return expand(expr, {expr->value});
+        ids.push_back(ast.add(NodeKind::Assign, expr->name, take()));
+    }
+    void visitCallExpr(CallExpr* expr) override {
+        if (!finishing) {
+            work.push_back({expr, nullptr, true});
+            for (size_t i = expr->arguments.size(); i-- > 0;) push(expr->arguments[i]);
+            return;
+        }
+        takeList(NodeKind::Call, expr->callee, expr->arguments.size());
+    }
+    void visitGroupingExpr(GroupingExpr* expr) override {
+        if (!finishing) return expand(expr, {expr->expression});
+        ids.push_back(ast.add(NodeKind::Grouping, noToken, take()));
+    }
+
+    void visitExpressionStmt(ExprStmt* stmt) override {
+        if (!finishing) return expand(stmt, {}, {stmt->expression});
+        ids.push_back(ast.add(NodeKind::ExprStmt, noToken, take()));
+    }
+    void visitPrintStmt(PrintStmt* stmt) override {
+        if (!finishing) return expand(stmt, {}, {stmt->expression});
+        ids.push_back(ast.add(NodeKind::Print, noToken, take()));
+    }
+    void visitVarStmt(VarStmt* stmt) override {
+        if (!finishing) return expand(stmt, {}, {stmt->initializer});
+        ids.push_back(ast.add(stmt->constant ? NodeKind::Const : NodeKind::Var, stmt->name, take()));
+    }
+    void visitBlockStmt(BlockStmt* stmt) override {
+        if (!finishing) {
+            work.push_back({nullptr, stmt, true});
+            for (size_t i = stmt->statements.size(); i-- > 0;) push(stmt->statements[i]);
+            return;
+        }
+        takeList(NodeKind::Block, noToken, stmt->statements.size());
+    }
+    void visitIfStmt(IfStmt* stmt) override {
+        if (!finishing) return expand(stmt, {stmt->thenBranch, stmt->elseBranch}, {stmt->condition});
+        NodeId elseBranch = take();
+        NodeId thenBranch = take();
+        NodeId condition = take();
+        ids.push_back(ast.add(NodeKind::If, noToken, condition, thenBranch, elseBranch));
+    }
+    void visitWhileStmt(WhileStmt* stmt) override {
+        if (!finishing) return expand(stmt, {stmt->body}, {stmt->condition});
+        NodeId body = take();
+        NodeId condition = take();
+        ids.push_back(ast.add(NodeKind::While, noToken, condition, body));
+    }
+    void visitForStmt(ForStmt* stmt) override {
+        if (!finishing) {
+            work.push_back({nullptr, stmt, true});
+            push(stmt->body);
+            push(stmt->increment);
+            push(stmt->condition);
+            push(stmt->initializer);
+            return;
+        }
+        takeList(NodeKind::For, noToken, 4);
+    }
+    void visitFunctionStmt(FunctionStmt* stmt) override {
+        if (finishing) {
+            takeList(NodeKind::Function, stmt->name, stmt->params.size() + stmt->body.size(),
+                     static_cast<NodeId>(stmt->params.size()));
+            return;
+        }
+        // Parameters come first in the list and take their ids before the body.
+        for (const Token& param : stmt->params) ids.push_back(ast.add(NodeKind::Variable, param));
+        if (stmt->deferred) {
+            NodeId bodyStart = ast.add(NodeKind::Literal, stmt->bodyStart);
+            takeList(NodeKind::DeferredFunction, stmt->name, stmt->params.size(), bodyStart);
+            return;
+        }
+        work.push_back({nullptr, stmt, true});
+        for (size_t i = stmt->body.size(); i-- > 0;) push(stmt->body[i]);
+    }
+    void visitReturnStmt(ReturnStmt* stmt) override {
+        if (!finishing) return expand(stmt, {}, {stmt->value});
+        ids.push_back(ast.add(NodeKind::Return, stmt->keyword, take()));
+    }
+
+private:
+    struct Work {
+        Expr* expr;
+        Stmt* stmt;
+        bool finish;
+    };
+
+    void push(Expr* expr) { work.push_back({expr, nullptr, false}); }
+    void push(Stmt* stmt) { work.push_back({nullptr, stmt, false}); }
+
+    // Queues the second visit of a node, then its children: expressions
+    // before statements, each group in order.
+    void expand(Expr* expr, std::initializer_list<Expr*> exprs) {
+        work.push_back({expr, nullptr, true});
+        for (auto it = exprs.end(); it != exprs.begin();) push(*--it);
+    }
+    void expand(Stmt* stmt, std::initializer_list<Stmt*> stmts, std::initializer_list<Expr*> exprs = {}) {
+        work.push_back({nullptr, stmt, true});
+        for (auto it = stmts.end(); it != stmts.begin();) push(*--it);
+        for (auto it = exprs.end(); it != exprs.begin();) push(*--it);
+    }
+
+    NodeId take() {
+        NodeId id = ids.back();
+        ids.pop_back();
+        return id;
+    }
+
+    // The node whose children are the last `count` ids.
+    void takeList(NodeKind kind, const Token& token, size_t count, NodeId first = NoNode) {
+        size_t base = ids.size() - count;
+        NodeId node = ast.addList(kind, token, ids.data() + base, count, first);
+        ids.resize(base);
+        ids.push_back(node);
+    }
+
+    FlatAst& ast;
+    std::vector<Work> work;
+    std::vector<NodeId> ids;
+    bool finishing = false;
+};
+
+// Inverse of Flattener. Because children precede their parents, one forward
+// pass over the nodes builds every child before it is needed; a child id
+// that does not point backwards means the arrays are corrupt.
+class Unflattener {
+public:
+    Unflattener(const FlatAstView& ast, std::string_view source, Arena& arena)
+        : ast(ast), source(source), arena(arena), exprs(ast.nodeCount), stmts(ast.nodeCount) {}
+
+    std::vector<Stmt*> convert() {
+        for (NodeId node = 0; node < ast.nodeCount; node++) build(node);
+        std::vector<Stmt*> statements;
+        statements.reserve(ast.rootCount);
+        for (size_t i = 0; i < ast.rootCount; i++) statements.push_back(stmt(ast.nodeCount, ast.roots[i]));
+        return statements;
+    }
+
+private:
+    [[noreturn]] static void corrupt(const char* what) {
+        throw std::runtime_error(std::string("FlatAst: ") + what);
+    }
+
+    const Token& token(NodeId node) const {
+        const Token& token = ast.tokens[node];
+        if (token.offset > source.size() || token.length > source.size() - token.offset) {
+            corrupt("token outside the source");
+        }
+        return token;
+    }
+
+    // Symbols are per process, so they are not stored; names are re-interned.
+    Symbol symbol(NodeId node) { return names.intern(token(node).text(source)); }
+
+    Expr* expr(size_t parent, NodeId child, bool optional = false) const {
+        if (child == NoNode && optional) return nullptr;
+        if (child >= parent || !exprs[child]) corrupt("bad expression child");
+        return exprs[child];
+    }
+
+    // Statement children may be NoNode wherever the parser produced none.
+    Stmt* stmt(size_t parent, NodeId child) const {
+        if (child == NoNode) return nullptr;
+        if (child >= parent || !stmts[child]) corrupt("bad statement child");
+        return stmts[child];
+    }
+
+    FlatList list(NodeId node) const {
+        if (ast.b[node] > ast.listCount || ast.c[node] > ast.listCount - ast.b[node]) {
+            corrupt("child list out of range");
+        }
+        return {ast.lists + ast.b[node], ast.c[node]};
+    }
+
+    void build(NodeId node) {
+        NodeId a = ast.a[node];
+        NodeId b = ast.b[node];
+        NodeId c = ast.c[node];
+        switch (ast.kinds[node]) {
+            case NodeKind::Binary: exprs[node] = arena.make<BinaryExpr>(expr(node, a), token(node), expr(node, b)); return;
+            case NodeKind::Unary: exprs[node] = arena.make<UnaryExpr>(token(node), expr(node, a)); return;
+            case NodeKind::Literal: exprs[node] = arena.make<LiteralExpr>(token(node)); return;
+            case NodeKind::Variable: exprs[node] = arena.make<VariableExpr>(token(node), symbol(node)); return;
+            case NodeKind::Assign:
+                exprs[node] = arena.make<AssignExpr>(token(node), symbol(node), expr(node, a));
+                return;
+            case NodeKind::Call: {
+                exprScratch.clear();
+                for (NodeId argument : list(node)) exprScratch.push_back(expr(node, argument));
+                exprs[node] = arena.make<CallExpr>(token(node), symbol(node),
+                                                   arena.copy(exprScratch.data(), exprScratch.size()));
+                return;
+            }
+            case NodeKind::Grouping: exprs[node] = arena.make<GroupingExpr>(expr(node, a)); return;
+            case NodeKind::ExprStmt: stmts[node] = arena.make<ExprStmt>(expr(node, a)); return;
+            case NodeKind::Print: stmts[node] = arena.make<PrintStmt>(expr(node, a)); return;
+            case NodeKind::Var: stmts[node] = arena.make<VarStmt>(token(node), symbol(node), expr(node, a, true)); return;
+            case NodeKind::Const:
+                stmts[node] = arena.make<VarStmt>(token(node), symbol(node), expr(node, a), true);
+                return;
+            case NodeKind::Block: {
+                stmtScratch.clear();
+                for (NodeId statement : list(node)) stmtScratch.push_back(stmt(node, statement));
+                stmts[node] = arena.make<BlockStmt>(arena.copy(stmtScratch.data(), stmtScratch.size()));
+                return;
+            }
+            case NodeKind::If:
+                stmts[node] = arena.make<IfStmt>(expr(node, a), stmt(node, b), stmt(node, c));
+                return;
+            case NodeKind::While: stmts[node] = arena.make<WhileStmt>(expr(node, a, true), stmt(node, b)); return;
+            case NodeKind::For: {
+                FlatList parts = list(node);
+                if (parts.size() != 4) corrupt("for statement needs four parts");
+                stmts[node] = arena.make<ForStmt>(stmt(node, parts[0]), expr(node, parts[1], true),
+                                                  expr(node, parts[2], true), stmt(node, parts[3]));
+                return;
+            }
+            case NodeKind::Function: {
+                FlatList parts = list(node);
+                if (a > parts.size()) corrupt("parameter count exceeds the list");
+                paramScratch.clear();
+                paramSymbols.clear();
+                for (uint32_t i = 0; i < a; i++) {
+                    if (parts[i] >= node || ast.kinds[parts[i]] != NodeKind::Variable) corrupt("bad parameter");
+                    paramScratch.push_back(token(parts[i]));
+                    paramSymbols.push_back(symbol(parts[i]));
+                }
+                stmtScratch.clear();
+                for (uint32_t i = a; i < parts.size(); i++) stmtScratch.push_back(stmt(node, parts[i]));
+                stmts[node] = arena.make<FunctionStmt>(token(node), symbol(node),
+                                                       arena.copy(paramScratch.data(), paramScratch.size()),
+                                                       arena.copy(paramSymbols.data(), paramSymbols.size()),
+                                                       arena.copy(stmtScratch.data(), stmtScratch.size()));
+                return;
+            }
+            case NodeKind::Return: stmts[node] = arena.make<ReturnStmt>(token(node), expr(node, a, true)); return;
+            case NodeKind::DeferredFunction: {
+                if (a >= node || ast.kinds[a] != NodeKind::Literal) corrupt("bad deferred body");
+                paramScratch.clear();
+                paramSymbols.clear();
+                for (NodeId param : list(node)) {
+                    if (param >= node || ast.kinds[param] != NodeKind::Variable) corrupt("bad parameter");
+                    paramScratch.push_back(token(param));
+                    paramSymbols.push_back(symbol(param));
+                }
+                stmts[node] = arena.make<FunctionStmt>(token(node), symbol(node),
+                                                       arena.copy(paramScratch.data(), paramScratch.size()),
+                                                       arena.copy(paramSymbols.data(), paramSymbols.size()),
+                                                       token(a));
+                return;
+            }
+        }
+        corrupt("unknown node kind");
+    }
+
+    const FlatAstView& ast;
+    std::string_view source;
+    Arena& arena;
+    std::vector<Expr*> exprs;  // node id -> built expression (null for statements)
+    std::vector<Stmt*> stmts;  // node id -> built statement (null for expressions)
+    std::vector<Expr*> exprScratch;
+    std::vector<Stmt*> stmtScratch;
+    std::vector<Token> paramScratch;
+    std::vector<Symbol> paramSymbols;
+    Interner::Cache names{Interner::shared()};
+};
+
+} // namespace
+
+NodeId FlatAst::add(NodeKind kind, const Token& token, NodeId first, NodeId second, NodeId third) {
+    if (kinds.size() >= NoNode) {
+        throw std::runtime_error("FlatAst: too many nodes");
+    }
+    kinds.push_back(kind);
+    tokens.push_back(token);
+    a.push_back(first);
+    b.push_back(second);
+    c.push_back(third);
+    return static_cast<NodeId>(kinds.size() - 1);
+}
+
+NodeId FlatAst::addList(NodeKind kind, const Token& token, const NodeId* items, size_t count, NodeId first) {
+    NodeId start = static_cast<NodeId>(lists.size());
+    lists.insert(lists.end(), items, items + count);
+    return add(kind, token, first, start, static_cast<NodeId>(count));
+}
+
+std::string FlatAst::toString(NodeId node, std::string_view source) const {
+    if (node == NoNode) return "null";
+    auto str = [&](NodeId child) { return toString(child, source); };
+    std::string token(tokens[node].text(source));
+    switch (kinds[node]) {
+        case NodeKind::Binary: return "BinaryExpr(" + str(a[node]) + ", " + token + ", " + str(b[node]) + ")";
+        case NodeKind::Unary: return "UnaryExpr(" + token + ", " + str(a[node]) + ")";
+        case NodeKind::Literal: return "LiteralExpr(" + token + ")";
+        case NodeKind::Variable: return "VariableExpr(" + token + ")";
+        case NodeKind::Assign: return "AssignExpr(" + token + ", " + str(a[node]) + ")";
+        case NodeKind::Call: {
+            std::string result = "CallExpr(" + token + ", [";
+            for (NodeId argument : list(node)) result += str(argument) + ", ";
+            return result + "])";
+        }
+        case NodeKind::Grouping: return "GroupingExpr(" + str(a[node]) + ")";
+        case NodeKind::ExprStmt: return "ExprStmt(" + str(a[node]) + ")";
+        case NodeKind::Print: return "PrintStmt(" + str(a[node]) + ")";
+        case NodeKind::Var: return "VarStmt(" + token + ", " + str(a[node]) + ")";
+        case NodeKind::Const: return "ConstStmt(" + token + ", " + str(a[node]) + ")";
+        case NodeKind::Block: {
+            std::string result = "BlockStmt([";
+            for (NodeId statement : list(node)) result += str(statement) + ", ";
+            return result + "])";
+        }
+        case NodeKind::If: return "IfStmt(" + str(a[node]) + ", " + str(b[node]) + ", " + str(c[node]) + ")";
+        case NodeKind::While:
+            return "WhileStmt(" + (a[node] == NoNode ? std::string("true") : str(a[node])) + ", " + str(b[node]) + ")";
+        case NodeKind::For: {
+            FlatList parts = list(node);
+            return "ForStmt(" + str(parts[0]) + ", " + str(parts[1]) + ", " + str(parts[2]) + ", " + str(parts[3]) + ")";
+        }
+        case NodeKind::Function: {
+            FlatList parts = list(node);
+            std::string result = "FunctionStmt(" + token + ", [";
+            for (uint32_t i = 0; i < a[node]; i++) result += std::string(tokens[parts[i]].text(source)) + ", ";
+            result += "], [";
+            for (uint32_t i = a[node]; i < parts.size(); i++) result += str(parts[i]) + ", ";
+            return result + "])";
+        }
+        case NodeKind::Return: return "ReturnStmt(" + token + ", " + str(a[node]) + ")";
+        case NodeKind::DeferredFunction: {
+            std::string result = "FunctionStmt(" + token + ", [";
+            for (NodeId param : list(node)) result += std::string(tokens[param].text(source)) + ", ";
+            return result + "], <deferred>)";
+        }
+    }
+    return "";
+}
+
+FlatAst flatten(const std::vector<Stmt*>& statements) {
+    FlatAst ast;
+    Flattener flattener(ast);
+    for (Stmt* statement : statements) ast.roots.push_back(flattener.convert(statement));
+    return ast;
+}
+
+std::vector<Stmt*> unflatten(const FlatAstView& ast, std::string_view source, Arena& arena) {
+    return Unflattener(ast, source, arena).convert();
+}
@@ -0,0 +1,56 @@
+#include "../include/interner.h"
+#include <cstring>
+#include <stdexcept>
+
+Interner::Interner() = default;
+
+Interner::~Interner() {
+    for (auto& bucket : buckets) delete[] bucket.load(std::memory_order_relaxed);
+}
+
+Symbol Interner::intern(std::string_view text, size_t hash) {
+    // The low bits pick the map bucket, so shard on the high ones.
+    Shard& shard = shards[(hash >> 24) % ShardCount];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.symbols.find(Key{text, hash});
+    if (it != shard.symbols.end()) return it->second;
+
+    Symbol symbol = count.load(std::memory_order_relaxed);
+    do {
+        if (symbol == NoSymbol) throw std::runtime_error("Interner: too many symbols");
+    } while (!count.compare_exchange_weak(symbol, symbol + 1, std::memory_order_acq_rel));
+
+    uint32_t bucket = bucketOf(symbol);
+    std::string_view* names = buckets[bucket].load(std::memory_order_acquire);
+    if (!names) {
+        std::lock_guard<std::mutex> grow(growMutex);
+        names = buckets[bucket].load(std::memory_order_relaxed);
+        if (!names) {
+            names = new std::string_view[static_cast<size_t>(FirstBucketSize) << bucket];
+            buckets[bucket].store(names, std::memory_order_release);
+        }
+    }
+
+    char* copy = static_cast<char*>(shard.text.allocate(text.size() ? text.size() : 1, 1));
+    std::memcpy(copy, text.data(), text.size());
+    std::string_view stored(copy, text.size());
+    names[symbol - bucketStart(bucket)] = stored;
+    shard.symbols.emplace(Key{stored, hash}, symbol);
+    return symbol;
+}
+
+Interner& Interner::shared() {
+    static Interner interner;
+    return interner;
+}
+
+Symbol Interner::Cache::intern(std::string_view text) {
+    size_t hash = Interner::hash(text);
+    Entry& entry = entries[hash % (sizeof(entries) / sizeof(entries[0]))];
+    if (entry.size == text.size() && entry.text && std::memcmp(entry.text, text.data(), text.size()) == 0) {
+        return entry.symbol;
+    }
+    Symbol symbol = interner.intern(text, hash);
+    if (text.size() <= UINT32_MAX) entry = {interner.name(symbol).data(), static_cast<uint32_t>(text.size()), symbol};
+    return symbol;
+}
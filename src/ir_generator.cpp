@@ -1,41 +1,94 @@
 #include "../include/ir_generator.h"
+#include "../include/flat_ast.h"
+#include "../include/parser.h"
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Verifier.h>
 #include <stdexcept>
+#include <unordered_set>
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
 #include <llvm/ExecutionEngine/GenericValue.h>
 #include <llvm/ExecutionEngine/MCJIT.h>
 #include <llvm/Support/TargetSelect.h>
 
-IRGenerator::IRGenerator() 
-    : module(std::make_unique<llvm::Module>("main", context))
-    , builder(context) {
+IRGenerator::IRGenerator(std::string_view source)
+    : source(source)
+    , module(std::make_unique<llvm::Module>("main", context))
+    , builder(context)
+    , types(source)
+    , folder(foldArena, source, types) {
 }
 
 IRGenerator::~IRGenerator() = default;
 
-std::unique_ptr<llvm::Module> IRGenerator::generate(const std::vector<std::unique_ptr<Stmt>>& statements) {
+std::unique_ptr<llvm::Module> IRGenerator::generate(const std::vector<Stmt*>& statements) {
+    for (Stmt* stmt : statements) {
+        resolver.resolve(stmt);
+    }
+    types.infer(
+        statements,
+        [this](FunctionStmt* function) {
+            Parser::parseBody(function, source, deferredArena);
+            resolver.resolveBody(function);
+        },
+        [this](const FunctionStmt* function) { return cloneFunction(function); });
+    for (Stmt* stmt : statements) {
+        lower(stmt);
+    }
+    return finish();
+}
+
+void IRGenerator::add(Stmt* stmt) {
+    if (stmt->kind == StmtKind::Function) {
+        // Kept, as the caller frees `stmt`, until a call gives it types
+        stmt = cloneFunction(static_cast<FunctionStmt*>(stmt));
+    } else {
+        resolver.resolve(stmt);
+    }
+    types.infer(stmt);
+    if (!mainFunction) beginMain();
+    for (uint32_t index : types.typedFunctions()) {
+        folder.foldFunction(types.signature(index).function);
+        declareFunction(index);
+        Task begin{Task::BeginFunction, types.signature(index).function};
+        begin.function = bodies[index];
+        tasks.push_back(begin);
+        run();
+    }
+    if (stmt->kind != StmtKind::Function) lower(stmt);
+    foldArena.rewind();
+}
+
+// Folds `stmt` and lowers what is left of it into main.
+void IRGenerator::lower(Stmt* stmt) {
+    if (!mainFunction) beginMain();
+    stmt = folder.fold(stmt);
+    if (!stmt) return;
+    push(Task::VisitStmt, stmt);
+    run();
+}
+
+void IRGenerator::beginMain() {
     llvm::FunctionType* mainType = llvm::FunctionType::get(
         llvm::Type::getInt32Ty(context),
         false
     );
-    llvm::Function* mainFunc = llvm::Function::Create(
+    mainFunction = llvm::Function::Create(
         mainType,
         llvm::Function::ExternalLinkage,
         "main",
         module.get()
     );
 
-    llvm::BasicBlock* entry = llvm::BasicBlock::Create(context, "entry", mainFunc);
+    llvm::BasicBlock* entry = llvm::BasicBlock::Create(context, "entry", mainFunction);
     builder.SetInsertPoint(entry);
+}
 
-    for (const auto& stmt : statements) {
-        generateStmt(stmt.get());
-    }
-
+std::unique_ptr<llvm::Module> IRGenerator::finish() {
+    if (!mainFunction) beginMain();
     builder.CreateRet(llvm::ConstantInt::get(context, llvm::APInt(32, 0)));
 
     if (llvm::verifyModule(*module, &llvm::errs())) {
@@ -45,34 +98,184 @@ std::unique_ptr<llvm::Module> IRGenerator::generate(const std::vector<std::uniqu
     return std::move(module);
 }
 
-void IRGenerator::generateStmt(const Stmt* stmt) {
-    if (auto exprStmt = dynamic_cast<const ExprStmt*>(stmt)) {
-        generateExprStmt(exprStmt);
-    } else if (auto printStmt = dynamic_cast<const PrintStmt*>(stmt)) {
-        generatePrintStmt(printStmt);
-    } else if (auto varStmt = dynamic_cast<const VarStmt*>(stmt)) {
-        generateVarStmt(varStmt);
-    } else if (auto blockStmt = dynamic_cast<const BlockStmt*>(stmt)) {
-        generateBlockStmt(blockStmt);
-    } else if (auto ifStmt = dynamic_cast<const IfStmt*>(stmt)) {
-        generateIfStmt(ifStmt);
-    } else if (auto whileStmt = dynamic_cast<const WhileStmt*>(stmt)) {
-        generateWhileStmt(whileStmt);
-    } else if (auto funcStmt = dynamic_cast<const FunctionStmt*>(stmt)) {
-        generateFunctionStmt(funcStmt);
-    } else if (auto returnStmt = dynamic_cast<const ReturnStmt*>(stmt)) {
-        generateReturnStmt(returnStmt);
-    } else if (auto forStmt = dynamic_cast<const ForStmt*>(stmt)) {
-        generateForStmt(forStmt);
+void IRGenerator::run() {
+    while (!tasks.empty()) {
+        Task task = tasks.back();
+        tasks.pop_back();
+        switch (task.kind) {
+            case Task::VisitStmt: visitStmt(task.stmt); break;
+            case Task::VisitExpr: visitExpr(task.expr); break;
+            case Task::Discard: pop(); break;
+            case Task::Print: generatePrintStmt(pop()); break;
+            case Task::Var: {
+                auto varStmt = static_cast<const VarStmt*>(task.stmt);
+                llvm::Type* type = getLLVMType(varStmt->type);
+                llvm::Value* initValue = varStmt->initializer ? convert(pop(), type) : llvm::Constant::getNullValue(type);
+                generateVarStmt(varStmt, initValue);
+                break;
+            }
+            case Task::Return: {
+                llvm::Type* type = builder.GetInsertBlock()->getParent()->getReturnType();
+                if (static_cast<const ReturnStmt*>(task.stmt)->value) {
+                    builder.CreateRet(convert(pop(), type));
+                } else {
+                    builder.CreateRet(llvm::Constant::getNullValue(type));
+                }
+                break;
+            }
+            case Task::Branch: {
+                auto ifStmt = static_cast<const IfStmt*>(task.stmt);
+                llvm::Value* cond = condition(pop());
+                llvm::Function* func = builder.GetInsertBlock()->getParent();
+                task.kind = Task::ElseBranch;
+                task.blocks[0] = llvm::BasicBlock::Create(context, "then", func);
+                task.blocks[1] = llvm::BasicBlock::Create(context, "else", func);
+                task.blocks[2] = llvm::BasicBlock::Create(context, "ifcont", func);
+
+                builder.CreateCondBr(cond, task.blocks[0], task.blocks[1]);
+
+                builder.SetInsertPoint(task.blocks[0]);
+                tasks.push_back(task);
+                push(Task::VisitStmt, ifStmt->thenBranch);
+                break;
+            }
+            case Task::ElseBranch: {
+                branchTo(task.blocks[2]);
+
+                builder.SetInsertPoint(task.blocks[1]);
+                task.kind = Task::EndIf;
+                tasks.push_back(task);
+                push(Task::VisitStmt, static_cast<const IfStmt*>(task.stmt)->elseBranch);
+                break;
+            }
+            case Task::EndIf:
+                branchTo(task.blocks[2]);
+                builder.SetInsertPoint(task.blocks[2]);
+                break;
+            case Task::LoopTest: {
+                // task.stmt is the loop body and task.expr the increment.
+                // A missing condition is always true.
+                if (llvm::Value* cond = pop()) {
+                    builder.CreateCondBr(condition(cond), task.blocks[1], task.blocks[2]);
+                } else {
+                    builder.CreateBr(task.blocks[1]);
+                }
+
+                builder.SetInsertPoint(task.blocks[1]);
+                const Expr* increment = task.expr;
+                task.kind = Task::EndLoop;
+                tasks.push_back(task);
+                if (increment) {
+                    push(Task::Discard, increment);
+                    push(Task::VisitExpr, increment);
+                }
+                push(Task::VisitStmt, task.stmt);
+                break;
+            }
+            case Task::EndLoop:
+                branchTo(task.blocks[0]);
+                builder.SetInsertPoint(task.blocks[2]);
+                break;
+            case Task::ForLoop: {
+                auto forStmt = static_cast<const ForStmt*>(task.stmt);
+                beginLoop(forStmt->body, forStmt->condition, forStmt->increment, "for");
+                break;
+            }
+            case Task::BeginFunction:
+                beginFunctionBody(static_cast<const FunctionStmt*>(task.stmt), task.function);
+                break;
+            case Task::EndFunction:
+                // If no return, add a default return of 0 (0.0, false, null)
+                if (!builder.GetInsertBlock()->getTerminator()) {
+                    builder.CreateRet(llvm::Constant::getNullValue(builder.GetInsertBlock()->getParent()->getReturnType()));
+                }
+
+                // Drop the function's slots and restore the insertion point
+                slots.resize(frame);
+                frame = task.frame;
+                if (task.blocks[1])
+                    builder.SetInsertPoint(task.blocks[1]);
+                break;
+            case Task::Binary: {
+                llvm::Value* right = pop();
+                llvm::Value* left = pop();
+                values.push_back(generateBinaryExpr(static_cast<const BinaryExpr*>(task.expr), left, right));
+                break;
+            }
+            case Task::Unary:
+                values.push_back(generateUnaryExpr(static_cast<const UnaryExpr*>(task.expr), pop()));
+                break;
+            case Task::Call:
+                values.push_back(generateCallExpr(static_cast<const CallExpr*>(task.expr), task.function));
+                break;
+            case Task::Assign:
+                values.push_back(generateAssignExpr(static_cast<const AssignExpr*>(task.expr), pop()));
+                break;
+        }
     }
 }
 
-void IRGenerator::generateExprStmt(const ExprStmt* stmt) {
-    generateExpr(stmt->expression.get());
+// Pushes the tasks for one statement; children are pushed last so they run
+// first, and in source order.
+void IRGenerator::visitStmt(const Stmt* stmt) {
+    if (!stmt) return;
+    switch (stmt->kind) {
+        case StmtKind::Expression:
+            push(Task::Discard, stmt);
+            push(Task::VisitExpr, static_cast<const ExprStmt*>(stmt)->expression);
+            break;
+        case StmtKind::Print:
+            push(Task::Print, stmt);
+            push(Task::VisitExpr, static_cast<const PrintStmt*>(stmt)->expression);
+            break;
+        case StmtKind::Var: {
+            auto varStmt = static_cast<const VarStmt*>(stmt);
+            push(Task::Var, stmt);
+            if (varStmt->initializer) push(Task::VisitExpr, varStmt->initializer);
+            break;
+        }
+        case StmtKind::Block: {
+            auto blockStmt = static_cast<const BlockStmt*>(stmt);
+            for (size_t i = blockStmt->statements.size(); i-- > 0;) {
+                push(Task::VisitStmt, blockStmt->statements[i]);
+            }
+            break;
+        }
+        case StmtKind::If:
+            push(Task::Branch, stmt);
+            push(Task::VisitExpr, static_cast<const IfStmt*>(stmt)->condition);
+            break;
+        case StmtKind::While: {
+            auto whileStmt = static_cast<const WhileStmt*>(stmt);
+            beginLoop(whileStmt->body, whileStmt->condition, nullptr, "while");
+            break;
+        }
+        case StmtKind::Function:
+            generateFunctionStmt(static_cast<const FunctionStmt*>(stmt));
+            break;
+        case StmtKind::Return: {
+            auto returnStmt = static_cast<const ReturnStmt*>(stmt);
+            push(Task::Return, stmt);
+            if (returnStmt->value) push(Task::VisitExpr, returnStmt->value);
+            break;
+        }
+        case StmtKind::For: {
+            // For loop: for (init; cond; inc) body;
+            // Translates to:
+            //   init;
+            //   while (cond) {
+            //     body;
+            //     inc;
+            //   }
+            auto forStmt = static_cast<const ForStmt*>(stmt);
+            push(Task::ForLoop, stmt);
+            if (forStmt->initializer) push(Task::VisitStmt, forStmt->initializer);
+            break;
+        }
+    }
 }
 
-void IRGenerator::generatePrintStmt(const PrintStmt* stmt) {
-    llvm::Value* value = generateExpr(stmt->expression.get());
+void IRGenerator::generatePrintStmt(llvm::Value* value) {
     if (!value) {
         throw std::runtime_error("Failed to generate expression for print statement");
     }
@@ -131,6 +334,11 @@ void IRGenerator::generatePrintStmt(const PrintStmt* stmt) {
         );
     }
 
+    // Bools print as 0 or 1
+    if (value->getType()->isIntegerTy(1)) {
+        value = builder.CreateZExt(value, intType);
+    }
+
     // Prepare arguments and call the appropriate function
     std::vector<llvm::Value*> args;
     if (value->getType()->isPointerTy()) {
@@ -150,306 +358,492 @@ void IRGenerator::generatePrintStmt(const PrintStmt* stmt) {
     }
 }
 
-void IRGenerator::generateVarStmt(const VarStmt* stmt) {
-    llvm::Value* initValue = nullptr;
-    if (stmt->initializer) {
-        initValue = generateExpr(stmt->initializer.get());
-    } else {
-        initValue = llvm::ConstantInt::get(context, llvm::APInt(32, 0));
-    }
-
-    llvm::AllocaInst* alloca = builder.CreateAlloca(initValue->getType(), nullptr, stmt->name.value);
+void IRGenerator::generateVarStmt(const VarStmt* stmt, llvm::Value* initValue) {
+    llvm::AllocaInst* alloca = builder.CreateAlloca(initValue->getType(), nullptr, text(stmt->name));
     builder.CreateStore(initValue, alloca);
-    setVariable(stmt->name.value, alloca);
-}
-
-void IRGenerator::generateBlockStmt(const BlockStmt* stmt) {
-    std::unordered_map<std::string, llvm::Value*> oldSymbolTable = symbolTable;
-    for (const auto& stmt : stmt->statements) {
-        generateStmt(stmt.get());
-    }
-    symbolTable = oldSymbolTable;
+    slot(stmt->slot) = alloca;
 }
 
-void IRGenerator::generateIfStmt(const IfStmt* stmt) {
-    llvm::Value* cond = generateExpr(stmt->condition.get());
+// Emits the loop header and jumps into it, then queues the test of the
+// condition (null if there is none), the body and the increment.
+void IRGenerator::beginLoop(const Stmt* body, const Expr* condition, const Expr* increment, const char* prefix) {
     llvm::Function* func = builder.GetInsertBlock()->getParent();
-    llvm::BasicBlock* thenBB = llvm::BasicBlock::Create(context, "then", func);
-    llvm::BasicBlock* elseBB = llvm::BasicBlock::Create(context, "else", func);
-    llvm::BasicBlock* mergeBB = llvm::BasicBlock::Create(context, "ifcont", func);
-
-    builder.CreateCondBr(cond, thenBB, elseBB);
+    Task test{Task::LoopTest, body, increment};
+    test.blocks[0] = llvm::BasicBlock::Create(context, std::string(prefix) + "cond", func);
+    test.blocks[1] = llvm::BasicBlock::Create(context, std::string(prefix) + "body", func);
+    test.blocks[2] = llvm::BasicBlock::Create(context, std::string(prefix) + "after", func);
 
-    builder.SetInsertPoint(thenBB);
-    generateStmt(stmt->thenBranch.get());
-    builder.CreateBr(mergeBB);
+    builder.CreateBr(test.blocks[0]);
+    builder.SetInsertPoint(test.blocks[0]);
 
-    builder.SetInsertPoint(elseBB);
-    if (stmt->elseBranch) {
-        generateStmt(stmt->elseBranch.get());
+    tasks.push_back(test);
+    if (condition) {
+        push(Task::VisitExpr, condition);
+    } else {
+        values.push_back(nullptr);
     }
-    builder.CreateBr(mergeBB);
-
-    builder.SetInsertPoint(mergeBB);
 }
 
-void IRGenerator::generateWhileStmt(const WhileStmt* stmt) {
-    llvm::Function* func = builder.GetInsertBlock()->getParent();
-    llvm::BasicBlock* condBB = llvm::BasicBlock::Create(context, "whilecond", func);
-    llvm::BasicBlock* bodyBB = llvm::BasicBlock::Create(context, "whilebody", func);
-    llvm::BasicBlock* afterBB = llvm::BasicBlock::Create(context, "whileafter", func);
-
-    builder.CreateBr(condBB);
-    builder.SetInsertPoint(condBB);
-
-    llvm::Value* cond = generateExpr(stmt->condition.get());
-    builder.CreateCondBr(cond, bodyBB, afterBB);
-
-    builder.SetInsertPoint(bodyBB);
-    generateStmt(stmt->body.get());
-    builder.CreateBr(condBB);
+// Queues the body of every specialization of the function; a function
+// that is never called has none. Streamed functions are lowered by add()
+// instead, with the statement that first calls them.
+void IRGenerator::generateFunctionStmt(const FunctionStmt* stmt) {
+    if (stmt->deferred || stmt->signature == UINT32_MAX) return;  // never called
+    if (types.signature(stmt->signature).sealed) return;
+    std::vector<uint32_t> specializations = types.specializations(stmt->signature);
+    for (size_t i = specializations.size(); i-- > 0;) {
+        FunctionStmt* function = types.signature(specializations[i]).function;
+        folder.foldFunction(function);
+        declareFunction(specializations[i]);
+        Task begin{Task::BeginFunction, function};
+        begin.function = bodies[specializations[i]];
+        tasks.push_back(begin);
+    }
+}
 
-    builder.SetInsertPoint(afterBB);
+// Copies a function for another specialization: flattening and rebuilding
+// the tree gives fresh nodes, which the resolver then binds to slots.
+FunctionStmt* IRGenerator::cloneFunction(const FunctionStmt* stmt) {
+    FlatAst flat = flatten({const_cast<FunctionStmt*>(stmt)});
+    auto copy = static_cast<FunctionStmt*>(unflatten(flat.view(), source, cloneArena).front());
+    resolver.resolveBody(copy);
+    return copy;
 }
 
-void IRGenerator::generateFunctionStmt(const FunctionStmt* stmt) {
-    // Create function type (assume all params and return are int32 for simplicity)
-    std::vector<llvm::Type*> paramTypes(stmt->params.size(), llvm::Type::getInt32Ty(context));
+// Returns the LLVM function of a signature, creating it on first use. A
+// function with several specializations gets its argument types appended to
+// its name, as in "add(int,int)". A memoized one gets its cache lookup under
+// that name, and its body in "<name>.body".
+llvm::Function* IRGenerator::declareFunction(uint32_t index) {
+    if (index >= functions.size()) {
+        functions.resize(index + 1);
+        bodies.resize(index + 1);
+    }
+    if (functions[index]) return functions[index];
+
+    // Create the function type from the inferred signature
+    const TypeInference::Signature& signature = types.signature(index);
+    std::vector<llvm::Type*> paramTypes;
+    for (ValueType type : signature.params) {
+        paramTypes.push_back(getLLVMType(type));
+    }
     llvm::FunctionType* funcType = llvm::FunctionType::get(
-        llvm::Type::getInt32Ty(context), // return type
+        getLLVMType(signature.result),
         paramTypes,
         false
     );
 
+    const FunctionStmt* stmt = signature.function;
+    std::string name = text(stmt->name);
+    if (types.specializations(signature.definition).size() > 1) {
+        name += '(';
+        for (size_t i = 0; i < signature.arguments.size(); i++) {
+            if (i > 0) name += ',';
+            name += typeName(signature.arguments[i]);
+        }
+        name += ')';
+    }
     llvm::Function* function = llvm::Function::Create(
         funcType,
         llvm::Function::ExternalLinkage,
-        stmt->name.value,
+        name,
         module.get()
     );
+    functions[index] = function;
+    bodies[index] = function;
+    if (memoize && memoizable(index)) {
+        bodies[index] = llvm::Function::Create(
+            funcType,
+            llvm::Function::InternalLinkage,
+            name + ".body",
+            module.get()
+        );
+    }
 
     // Set names for arguments
-    unsigned idx = 0;
-    for (auto& arg : function->args()) {
-        arg.setName(stmt->params[idx++].value);
+    for (llvm::Function* f : {function, bodies[index]}) {
+        unsigned idx = 0;
+        for (auto& arg : f->args()) {
+            arg.setName(text(stmt->params[idx++]));
+        }
     }
+    if (bodies[index] != function) generateMemoWrapper(function, bodies[index]);
+    return function;
+}
 
-    // Create a new basic block to start insertion into
-    llvm::BasicBlock* block = llvm::BasicBlock::Create(context, "entry", function);
-    auto* oldInsertBlock = builder.GetInsertBlock();
-    builder.SetInsertPoint(block);
-
-    // Save old symbol table
-    std::unordered_map<std::string, llvm::Value*> oldSymbolTable = symbolTable;
-
-    // Allocate space for arguments and store them in the symbol table
-    idx = 0;
-    for (auto& arg : function->args()) {
-        llvm::AllocaInst* alloca = builder.CreateAlloca(llvm::Type::getInt32Ty(context), nullptr, arg.getName());
-        builder.CreateStore(&arg, alloca);
-        symbolTable[arg.getName().str()] = alloca;
-    }
+// Whether calls to a function can be served from a cache: its parameters and
+// result are ints, it calls itself (directly or through other functions),
+// and neither it nor anything it calls prints. Functions cannot see main's
+// variables, so printing is the only side effect a call can have and equal
+// arguments always give equal results. Records the function's purity, for
+// the functions declared after it.
+bool IRGenerator::memoizable(uint32_t index) {
+    if (index >= purity.size()) purity.resize(index + 1, Purity::Unknown);
+    const TypeInference::Signature& signature = types.signature(index);
+
+    // Walks the bodies the function can reach, each once
+    std::vector<const Stmt*> stmts(signature.function->body.begin(), signature.function->body.end());
+    std::vector<const Expr*> exprs;
+    std::unordered_set<uint32_t> visited{index};
+    bool recursive = false;
+    bool pure = true;
+    auto stmt = [&stmts](const Stmt* s) { if (s) stmts.push_back(s); };
+    auto expr = [&exprs](const Expr* e) { if (e) exprs.push_back(e); };
+    while (pure && (!stmts.empty() || !exprs.empty())) {
+        if (!exprs.empty()) {
+            const Expr* e = exprs.back();
+            exprs.pop_back();
+            switch (e->kind) {
+                case ExprKind::Binary:
+                    expr(static_cast<const BinaryExpr*>(e)->left);
+                    expr(static_cast<const BinaryExpr*>(e)->right);
+                    break;
+                case ExprKind::Unary: expr(static_cast<const UnaryExpr*>(e)->right); break;
+                case ExprKind::Grouping: expr(static_cast<const GroupingExpr*>(e)->expression); break;
+                case ExprKind::Assign: expr(static_cast<const AssignExpr*>(e)->value); break;
+                case ExprKind::Literal:
+                case ExprKind::Variable:
+                    break;
+                case ExprKind::Call: {
+                    auto call = static_cast<const CallExpr*>(e);
+                    for (const Expr* argument : call->arguments) expr(argument);
+                    uint32_t callee = call->signature;
+                    if (callee == index) {
+                        recursive = true;
+                    } else if (callee == UINT32_MAX || (callee < purity.size() && purity[callee] == Purity::Impure)) {
+                        pure = false;
+                    } else if (visited.insert(callee).second) {
+                        // A sealed (streamed) callee was declared, and its
+                        // purity recorded, before this function existed
+                        const TypeInference::Signature& target = types.signature(callee);
+                        if (target.sealed || target.function->deferred) {
+                            pure = callee < purity.size() && purity[callee] == Purity::Pure;
+                        } else {
+                            for (const Stmt* s : target.function->body) stmt(s);
+                        }
+                    }
+                    break;
+                }
+            }
+            continue;
+        }
 
-    // Generate function body
-    for (const auto& s : stmt->body) {
-        generateStmt(s.get());
+        const Stmt* s = stmts.back();
+        stmts.pop_back();
+        switch (s->kind) {
+            case StmtKind::Print: pure = false; break;
+            case StmtKind::Expression: expr(static_cast<const ExprStmt*>(s)->expression); break;
+            case StmtKind::Var: expr(static_cast<const VarStmt*>(s)->initializer); break;
+            case StmtKind::Return: expr(static_cast<const ReturnStmt*>(s)->value); break;
+            case StmtKind::Block:
+                for (const Stmt* child : static_cast<const BlockStmt*>(s)->statements) stmt(child);
+                break;
+            case StmtKind::If: {
+                auto ifStmt = static_cast<const IfStmt*>(s);
+                expr(ifStmt->condition);
+                stmt(ifStmt->thenBranch);
+                stmt(ifStmt->elseBranch);
+                break;
+            }
+            case StmtKind::While:
+                expr(static_cast<const WhileStmt*>(s)->condition);
+                stmt(static_cast<const WhileStmt*>(s)->body);
+                break;
+            case StmtKind::For: {
+                auto forStmt = static_cast<const ForStmt*>(s);
+                stmt(forStmt->initializer);
+                expr(forStmt->condition);
+                expr(forStmt->increment);
+                stmt(forStmt->body);
+                break;
+            }
+            case StmtKind::Function:
+                break;  // a nested definition runs only when called
+        }
     }
+    purity[index] = pure ? Purity::Pure : Purity::Impure;
 
-    // If no return, add a default return 0
-    if (!block->getTerminator()) {
-        builder.CreateRet(llvm::ConstantInt::get(context, llvm::APInt(32, 0)));
+    if (!pure || !recursive || signature.params.empty() || signature.result != ValueType::Int) return false;
+    for (ValueType type : signature.params) {
+        if (type != ValueType::Int) return false;
     }
-
-    // Restore old symbol table and insertion point
-    symbolTable = oldSymbolTable;
-    if (oldInsertBlock)
-        builder.SetInsertPoint(oldInsertBlock);
+    return true;
 }
 
-void IRGenerator::generateReturnStmt(const ReturnStmt* stmt) {
-    if (stmt->value) {
-        llvm::Value* retVal = generateExpr(stmt->value.get());
-        builder.CreateRet(retVal);
-    } else {
-        builder.CreateRetVoid();
+// Fills `function` with a lookup in a direct-mapped cache of 4096 entries
+// that falls back to calling `body` and storing what it returns. The entry
+// is picked by an FNV-1a style hash of the arguments; its keys must equal
+// them all for a hit, and a newer result simply replaces an older one.
+void IRGenerator::generateMemoWrapper(llvm::Function* function, llvm::Function* body) {
+    constexpr unsigned EntryBits = 12;
+    llvm::IRBuilderBase::InsertPointGuard guard(builder);  // may be declared mid-function
+    std::string name = function->getName().str();
+    size_t count = function->arg_size();
+    llvm::Type* intType = builder.getInt32Ty();
+    llvm::ArrayType* keyType = llvm::ArrayType::get(intType, count);
+    llvm::ArrayType* keysType = llvm::ArrayType::get(keyType, 1u << EntryBits);
+    llvm::ArrayType* valuesType = llvm::ArrayType::get(intType, 1u << EntryBits);
+    llvm::ArrayType* usedType = llvm::ArrayType::get(builder.getInt8Ty(), 1u << EntryBits);
+    auto table = [this, &name](llvm::ArrayType* type, const char* suffix) {
+        return new llvm::GlobalVariable(*module, type, false, llvm::GlobalValue::InternalLinkage,
+                                        llvm::ConstantAggregateZero::get(type), name + ".memo." + suffix);
+    };
+    llvm::GlobalVariable* keys = table(keysType, "keys");
+    llvm::GlobalVariable* values = table(valuesType, "values");
+    llvm::GlobalVariable* used = table(usedType, "used");
+
+    llvm::BasicBlock* entry = llvm::BasicBlock::Create(context, "entry", function);
+    llvm::BasicBlock* hit = llvm::BasicBlock::Create(context, "hit", function);
+    llvm::BasicBlock* miss = llvm::BasicBlock::Create(context, "miss", function);
+    builder.SetInsertPoint(entry);
+
+    std::vector<llvm::Value*> args;
+    llvm::Value* hash = builder.getInt32(2166136261u);
+    for (auto& arg : function->args()) {
+        args.push_back(&arg);
+        hash = builder.CreateMul(builder.CreateXor(hash, &arg), builder.getInt32(16777619u), "hash");
     }
-}
+    llvm::Value* entryIndex = builder.CreateZExt(builder.CreateLShr(hash, 32 - EntryBits), builder.getInt64Ty(), "entry");
+    llvm::Value* zero = builder.getInt64(0);
+    auto element = [this, zero, entryIndex](llvm::ArrayType* type, llvm::Value* array) {
+        return builder.CreateInBoundsGEP(type, array, {zero, entryIndex});
+    };
+
+    llvm::Value* usedSlot = element(usedType, used);
+    llvm::Value* found = builder.CreateICmpNE(builder.CreateLoad(builder.getInt8Ty(), usedSlot), builder.getInt8(0), "used");
+    llvm::Value* keySlot = element(keysType, keys);
+    std::vector<llvm::Value*> keySlots;
+    for (size_t i = 0; i < count; i++) {
+        keySlots.push_back(builder.CreateInBoundsGEP(keyType, keySlot, {zero, builder.getInt64(i)}));
+        llvm::Value* key = builder.CreateLoad(intType, keySlots[i]);
+        found = builder.CreateAnd(found, builder.CreateICmpEQ(key, args[i]), "found");
+    }
+    llvm::Value* valueSlot = element(valuesType, values);
+    builder.CreateCondBr(found, hit, miss);
 
-void IRGenerator::generateForStmt(const ForStmt* stmt) {
-    // For loop: for (init; cond; inc) body;
-    // Translates to:
-    //   init;
-    //   while (cond) {
-    //     body;
-    //     inc;
-    //   }
+    builder.SetInsertPoint(hit);
+    builder.CreateRet(builder.CreateLoad(intType, valueSlot, "cached"));
 
-    // Execute initializer
-    if (stmt->initializer) {
-        generateStmt(stmt->initializer.get());
+    builder.SetInsertPoint(miss);
+    llvm::Value* result = builder.CreateCall(body, args, "result");
+    builder.CreateStore(builder.getInt8(1), usedSlot);
+    for (size_t i = 0; i < count; i++) {
+        builder.CreateStore(args[i], keySlots[i]);
     }
+    builder.CreateStore(result, valueSlot);
+    builder.CreateRet(result);
+}
 
-    // Create blocks for loop
-    llvm::Function* func = builder.GetInsertBlock()->getParent();
-    llvm::BasicBlock* condBB = llvm::BasicBlock::Create(context, "forcond", func);
-    llvm::BasicBlock* bodyBB = llvm::BasicBlock::Create(context, "forbody", func);
-    llvm::BasicBlock* afterBB = llvm::BasicBlock::Create(context, "forafter", func);
+// Opens the function's entry block and binds the parameters, then queues
+// the body and the EndFunction task that closes it.
+void IRGenerator::beginFunctionBody(const FunctionStmt* stmt, llvm::Function* function) {
+    // Create a new basic block to start insertion into
+    llvm::BasicBlock* block = llvm::BasicBlock::Create(context, "entry", function);
+    Task end{Task::EndFunction, stmt};
+    end.blocks[0] = block;
+    end.blocks[1] = builder.GetInsertBlock();
+    builder.SetInsertPoint(block);
 
-    builder.CreateBr(condBB);
-    builder.SetInsertPoint(condBB);
+    // The function's slots start past everything the caller has in use
+    end.frame = frame;
+    frame = slots.size();
 
-    // Condition
-    llvm::Value* cond = nullptr;
-    if (stmt->condition) {
-        cond = generateExpr(stmt->condition.get());
-    } else {
-        cond = llvm::ConstantInt::getTrue(context);
+    // Allocate space for arguments; argument i lives in slot i
+    uint32_t idx = 0;
+    for (auto& arg : function->args()) {
+        llvm::AllocaInst* alloca = builder.CreateAlloca(arg.getType(), nullptr, arg.getName());
+        builder.CreateStore(&arg, alloca);
+        slot(idx++) = alloca;
     }
-    builder.CreateCondBr(cond, bodyBB, afterBB);
 
-    // Body
-    builder.SetInsertPoint(bodyBB);
-    generateStmt(stmt->body.get());
-    // Increment
-    if (stmt->increment) {
-        generateExpr(stmt->increment.get());
+    tasks.push_back(end);
+    for (size_t i = stmt->body.size(); i-- > 0;) {
+        push(Task::VisitStmt, stmt->body[i]);
     }
-    builder.CreateBr(condBB);
-
-    // After loop
-    builder.SetInsertPoint(afterBB);
 }
 
-llvm::Value* IRGenerator::generateExpr(const Expr* expr) {
-    if (auto binary = dynamic_cast<const BinaryExpr*>(expr)) {
-        return generateBinaryExpr(binary);
-    } else if (auto unary = dynamic_cast<const UnaryExpr*>(expr)) {
-        return generateUnaryExpr(unary);
-    } else if (auto literal = dynamic_cast<const LiteralExpr*>(expr)) {
-        return generateLiteralExpr(literal);
-    } else if (auto variable = dynamic_cast<const VariableExpr*>(expr)) {
-        return generateVariableExpr(variable);
-    } else if (auto call = dynamic_cast<const CallExpr*>(expr)) {
-        return generateCallExpr(call);
-    } else if (auto grouping = dynamic_cast<const GroupingExpr*>(expr)) {
-        return generateGroupingExpr(grouping);
-    } else if (auto assign = dynamic_cast<const AssignExpr*>(expr)) {
-        return generateAssignExpr(assign);
+// Pushes the tasks for one expression, or its value if it has no operands.
+void IRGenerator::visitExpr(const Expr* expr) {
+    switch (expr->kind) {
+        case ExprKind::Binary: {
+            auto binary = static_cast<const BinaryExpr*>(expr);
+            push(Task::Binary, expr);
+            push(Task::VisitExpr, binary->right);
+            push(Task::VisitExpr, binary->left);
+            break;
+        }
+        case ExprKind::Unary:
+            push(Task::Unary, expr);
+            push(Task::VisitExpr, static_cast<const UnaryExpr*>(expr)->right);
+            break;
+        case ExprKind::Literal:
+            values.push_back(generateLiteralExpr(static_cast<const LiteralExpr*>(expr)));
+            break;
+        case ExprKind::Variable:
+            values.push_back(generateVariableExpr(static_cast<const VariableExpr*>(expr)));
+            break;
+        case ExprKind::Call: {
+            auto call = static_cast<const CallExpr*>(expr);
+            Task finish{Task::Call, nullptr, expr};
+            finish.function = resolveCallee(call);
+            tasks.push_back(finish);
+            for (size_t i = call->arguments.size(); i-- > 0;) {
+                push(Task::VisitExpr, call->arguments[i]);
+            }
+            break;
+        }
+        case ExprKind::Grouping:
+            push(Task::VisitExpr, static_cast<const GroupingExpr*>(expr)->expression);
+            break;
+        case ExprKind::Assign:
+            push(Task::Assign, expr);
+            push(Task::VisitExpr, static_cast<const AssignExpr*>(expr)->value);
+            break;
     }
-    return nullptr;
 }
 
-llvm::Value* IRGenerator::generateBinaryExpr(const BinaryExpr* expr) {
-    llvm::Value* left = generateExpr(expr->left.get());
-    llvm::Value* right = generateExpr(expr->right.get());
-
+// Operands were typed by TypeInference: both numbers, or (for == and !=)
+// both bools. An int operand next to a double one is converted first.
+llvm::Value* IRGenerator::generateBinaryExpr(const BinaryExpr* expr, llvm::Value* left, llvm::Value* right) {
     if (!left || !right) {
         throw std::runtime_error("Failed to generate binary expression operands");
     }
 
-    // Load values if they are pointers
-    if (left->getType()->isPointerTy()) {
-        left = builder.CreateLoad(builder.getInt32Ty(), left);
-    }
-    if (right->getType()->isPointerTy()) {
-        right = builder.CreateLoad(builder.getInt32Ty(), right);
-    }
-
-    if (left->getType() != right->getType()) {
-        throw std::runtime_error("Type mismatch in binary expression");
+    bool isDouble = expr->left->type == ValueType::Double || expr->right->type == ValueType::Double;
+    if (isDouble) {
+        left = convert(left, builder.getDoubleTy());
+        right = convert(right, builder.getDoubleTy());
     }
 
-    if (expr->op.type == TokenType::ARITHMETIC) {
-        if (expr->op.value == "+") return builder.CreateAdd(left, right, "addtmp");
-        if (expr->op.value == "-") return builder.CreateSub(left, right, "subtmp");
-        if (expr->op.value == "*") return builder.CreateMul(left, right, "multmp");
-        if (expr->op.value == "/") return builder.CreateSDiv(left, right, "divtmp");
+    std::string_view op = expr->op.text(source);
+    if (expr->op.type == TokenType::ARITHMETIC && isDouble) {
+        if (op == "+") return builder.CreateFAdd(left, right, "addtmp");
+        if (op == "-") return builder.CreateFSub(left, right, "subtmp");
+        if (op == "*") return builder.CreateFMul(left, right, "multmp");
+        if (op == "/") return builder.CreateFDiv(left, right, "divtmp");
+    } else if (expr->op.type == TokenType::ARITHMETIC) {
+        if (op == "+") return builder.CreateAdd(left, right, "addtmp");
+        if (op == "-") return builder.CreateSub(left, right, "subtmp");
+        if (op == "*") return builder.CreateMul(left, right, "multmp");
+        if (op == "/") return builder.CreateSDiv(left, right, "divtmp");
+    } else if (expr->op.type == TokenType::COMPARE && isDouble) {
+        if (op == "<") return builder.CreateFCmpOLT(left, right, "cmptmp");
+        if (op == ">") return builder.CreateFCmpOGT(left, right, "cmptmp");
+        if (op == "<=") return builder.CreateFCmpOLE(left, right, "cmptmp");
+        if (op == ">=") return builder.CreateFCmpOGE(left, right, "cmptmp");
+        if (op == "==") return builder.CreateFCmpOEQ(left, right, "cmptmp");
+        if (op == "!=") return builder.CreateFCmpUNE(left, right, "cmptmp");
     } else if (expr->op.type == TokenType::COMPARE) {
-        if (expr->op.value == "<") return builder.CreateICmpSLT(left, right, "cmptmp");
-        if (expr->op.value == ">") return builder.CreateICmpSGT(left, right, "cmptmp");
-        if (expr->op.value == "<=") return builder.CreateICmpSLE(left, right, "cmptmp");
-        if (expr->op.value == ">=") return builder.CreateICmpSGE(left, right, "cmptmp");
-        if (expr->op.value == "==") return builder.CreateICmpEQ(left, right, "cmptmp");
-        if (expr->op.value == "!=") return builder.CreateICmpNE(left, right, "cmptmp");
+        if (op == "<") return builder.CreateICmpSLT(left, right, "cmptmp");
+        if (op == ">") return builder.CreateICmpSGT(left, right, "cmptmp");
+        if (op == "<=") return builder.CreateICmpSLE(left, right, "cmptmp");
+        if (op == ">=") return builder.CreateICmpSGE(left, right, "cmptmp");
+        if (op == "==") return builder.CreateICmpEQ(left, right, "cmptmp");
+        if (op == "!=") return builder.CreateICmpNE(left, right, "cmptmp");
     }
 
-    throw std::runtime_error("Unsupported binary operator: " + expr->op.value);
+    throw std::runtime_error("Unsupported binary operator: " + text(expr->op));
 }
 
-llvm::Value* IRGenerator::generateUnaryExpr(const UnaryExpr* expr) {
-    llvm::Value* operand = generateExpr(expr->right.get());
+llvm::Value* IRGenerator::generateUnaryExpr(const UnaryExpr* expr, llvm::Value* operand) {
     if (!operand) {
         throw std::runtime_error("Failed to generate unary expression operand");
     }
 
-    if (expr->op.value == "-") return builder.CreateNeg(operand, "negtmp");
-    if (expr->op.value == "!") return builder.CreateNot(operand, "nottmp");
+    std::string_view op = expr->op.text(source);
+    if (op == "-" && expr->type == ValueType::Double) return builder.CreateFNeg(operand, "negtmp");
+    if (op == "-") return builder.CreateNeg(operand, "negtmp");
+    if (op == "!") {
+        // Logical: true for false and for zero
+        llvm::Type* type = operand->getType();
+        if (type->isIntegerTy(1)) return builder.CreateNot(operand, "nottmp");
+        if (type->isIntegerTy()) return builder.CreateICmpEQ(operand, llvm::ConstantInt::get(type, 0), "nottmp");
+        if (type->isDoubleTy()) return builder.CreateFCmpOEQ(operand, llvm::ConstantFP::get(type, 0.0), "nottmp");
+    }
 
-    throw std::runtime_error("Unsupported unary operator: " + expr->op.value);
+    throw std::runtime_error("Unsupported unary operator: " + text(expr->op));
 }
 
 llvm::Value* IRGenerator::generateLiteralExpr(const LiteralExpr* expr) {
+    if (expr->folded) {
+        if (expr->type == ValueType::Double) return llvm::ConstantFP::get(builder.getDoubleTy(), expr->constant);
+        auto value = static_cast<int64_t>(expr->constant);
+        return llvm::ConstantInt::get(getLLVMType(expr->type), static_cast<uint64_t>(value), expr->type == ValueType::Int);
+    }
     if (expr->value.type == TokenType::INT_LITERAL) {
-        return llvm::ConstantInt::get(context, llvm::APInt(32, std::stoi(expr->value.value)));
+        return llvm::ConstantInt::get(context, llvm::APInt(32, std::stoi(text(expr->value))));
     } else if (expr->value.type == TokenType::FLOAT_LITERAL) {
-        return llvm::ConstantFP::get(context, llvm::APFloat(std::stof(expr->value.value)));
+        return llvm::ConstantFP::get(builder.getDoubleTy(), std::stod(text(expr->value)));
     } else if (expr->value.type == TokenType::BOOL_LITERAL) {
-        return llvm::ConstantInt::get(context, llvm::APInt(1, expr->value.value == "true"));
+        return llvm::ConstantInt::get(context, llvm::APInt(1, expr->value.text(source) == "true"));
     } else if (expr->value.type == TokenType::STRING_LITERAL) {
-        // Remove quotes from string literal
-        std::string str = expr->value.value;
-        if (str.size() >= 2 && str.front() == '"' && str.back() == '"') {
-            str = str.substr(1, str.size() - 2);
-        }
-        return builder.CreateGlobalStringPtr(str);
+        // The token spans the contents only, without the quotes
+        return builder.CreateGlobalStringPtr(text(expr->value));
     }
     return nullptr;
 }
 
 llvm::Value* IRGenerator::generateVariableExpr(const VariableExpr* expr) {
-    llvm::Value* alloca = getVariable(expr->name.value);
-    return builder.CreateLoad(builder.getInt32Ty(), alloca);
+    llvm::Value* alloca = slot(expr->slot);
+    return builder.CreateLoad(getLLVMType(expr->type), alloca);
 }
 
-llvm::Value* IRGenerator::generateCallExpr(const CallExpr* expr) {
-    // Find the function in the module
-    llvm::Function* calleeFunc = module->getFunction(expr->callee.value);
-    if (!calleeFunc) {
-        throw std::runtime_error("Unknown function referenced: " + expr->callee.value);
+// Looks the callee up before its arguments are generated.
+llvm::Function* IRGenerator::resolveCallee(const CallExpr* expr) {
+    if (expr->signature == UINT32_MAX) {
+        throw std::runtime_error("Unknown function referenced: " + text(expr->callee));
     }
+    return declareFunction(expr->signature);
+}
 
-    std::vector<llvm::Value*> args;
-    for (const auto& arg : expr->arguments) {
-        llvm::Value* argVal = generateExpr(arg.get());
-        if (!argVal) throw std::runtime_error("Null argument in function call");
-        args.push_back(argVal);
+// The arguments are the last arguments.size() entries on `values`.
+llvm::Value* IRGenerator::generateCallExpr(const CallExpr* expr, llvm::Function* callee) {
+    auto first = values.end() - static_cast<std::ptrdiff_t>(expr->arguments.size());
+    std::vector<llvm::Value*> args(first, values.end());
+    values.erase(first, values.end());
+    for (size_t i = 0; i < args.size(); i++) {
+        if (!args[i]) throw std::runtime_error("Null argument in function call");
+        args[i] = convert(args[i], callee->getFunctionType()->getParamType(static_cast<unsigned>(i)));
     }
 
-    return builder.CreateCall(calleeFunc, args, "calltmp");
-}
-
-llvm::Value* IRGenerator::generateGroupingExpr(const GroupingExpr* expr) {
-    return generateExpr(expr->expression.get());
+    return builder.CreateCall(callee, args, "calltmp");
 }
 
-llvm::Value* IRGenerator::generateAssignExpr(const AssignExpr* expr) {
-    llvm::Value* value = generateExpr(expr->value.get());
-    llvm::Value* variable = getVariable(expr->name.value);
+llvm::Value* IRGenerator::generateAssignExpr(const AssignExpr* expr, llvm::Value* value) {
+    llvm::Value* variable = slot(expr->slot);
+    value = convert(value, getLLVMType(expr->type));
     builder.CreateStore(value, variable);
     return value;
 }
 
-llvm::Value* IRGenerator::getVariable(const std::string& name) {
-    auto it = symbolTable.find(name);
-    if (it == symbolTable.end()) {
-        throw std::runtime_error("Undefined variable: " + name);
+llvm::Type* IRGenerator::getLLVMType(ValueType type) {
+    switch (type) {
+        case ValueType::Int: return builder.getInt32Ty();
+        case ValueType::Double: return builder.getDoubleTy();
+        case ValueType::Bool: return builder.getInt1Ty();
+        case ValueType::String: return builder.getInt8PtrTy();
+        case ValueType::Unknown: break;
     }
-    return it->second;  // Return the alloca instruction directly
+    throw std::runtime_error("Expression has no inferred type");
 }
 
-void IRGenerator::setVariable(const std::string& name, llvm::Value* value) {
-    if (!value) {
-        throw std::runtime_error("Cannot set null value for variable: " + name);
+llvm::Value* IRGenerator::convert(llvm::Value* value, llvm::Type* type) {
+    if (value->getType() == type) return value;
+    if (value->getType()->isIntegerTy(32) && type->isDoubleTy()) {
+        return builder.CreateSIToFP(value, type, "conv");
     }
-    symbolTable[name] = value;
+    throw std::runtime_error("Cannot convert value to the expected type");
+}
+
+// Branches to `block` unless the current block already ended, in a return.
+void IRGenerator::branchTo(llvm::BasicBlock* block) {
+    if (!builder.GetInsertBlock()->getTerminator()) builder.CreateBr(block);
+}
+
+llvm::Value* IRGenerator::condition(llvm::Value* value) {
+    llvm::Type* type = value->getType();
+    if (type->isIntegerTy(1)) return value;
+    if (type->isIntegerTy()) return builder.CreateICmpNE(value, llvm::ConstantInt::get(type, 0), "tobool");
+    if (type->isDoubleTy()) return builder.CreateFCmpUNE(value, llvm::ConstantFP::get(type, 0.0), "tobool");
+    throw std::runtime_error("Condition must be a bool or a number");
 }
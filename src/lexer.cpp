@@ -1,197 +1,627 @@
 #include "../include/lexer.h"
-#include <cctype>
+#include "../include/simd_scan.h"
+#include "../include/thread_pool.h"
+#include <cstdint>
 #include <stdexcept>
-#include <unordered_map>
 #include <algorithm>
+#include <deque>
+#include <future>
 #include <iostream>
 
-static const std::unordered_map<std::string, TokenType> keywords = {
-    {"func", TokenType::KEYWORD},
-    {"if", TokenType::KEYWORD},
-    {"else", TokenType::KEYWORD},
-    {"while", TokenType::KEYWORD},
-    {"for", TokenType::KEYWORD},
-    {"screenit", TokenType::KEYWORD},
-    {"return", TokenType::KEYWORD},
-    {"var", TokenType::KEYWORD},
+namespace {
+
+struct Keyword {
+    std::string_view text;
+    TokenType type;
+};
+
+constexpr Keyword keywordList[] = {
+    {"func", TokenType::KW_FUNC},
+    {"if", TokenType::KW_IF},
+    {"else", TokenType::KW_ELSE},
+    {"while", TokenType::KW_WHILE},
+    {"for", TokenType::KW_FOR},
+    {"screenit", TokenType::KW_SCREENIT},
+    {"return", TokenType::KW_RETURN},
+    {"var", TokenType::KW_VAR},
+    {"const", TokenType::KW_CONST},
     {"true", TokenType::BOOL_LITERAL},
     {"false", TokenType::BOOL_LITERAL},
-    {"break", TokenType::KEYWORD}
+    {"break", TokenType::KW_BREAK}
 };
 
-// Helper function to trim whitespace
-static std::string trim(const std::string& str) {
-    size_t first = str.find_first_not_of(" \t\n\r");
-    if (first == std::string::npos) return "";
-    size_t last = str.find_last_not_of(" \t\n\r");
-    return str.substr(first, (last - first + 1));
+// Keywords are recognised with a perfect hash whose seed is searched for at
+// compile time: every keyword lands in its own slot, so a lookup is one hash
+// of (first char, last char, length) plus one comparison, with no allocation.
+constexpr size_t keywordTableBits = 5;
+constexpr size_t keywordTableSize = size_t(1) << keywordTableBits;
+
+constexpr uint32_t keywordHash(std::string_view text, uint32_t seed) {
+    uint32_t h = seed;
+    h = (h ^ static_cast<unsigned char>(text[0])) * 16777619u;
+    h = (h ^ static_cast<unsigned char>(text[text.size() - 1])) * 16777619u;
+    h = (h ^ static_cast<uint32_t>(text.size())) * 16777619u;
+    return h >> (32 - keywordTableBits);
 }
 
-Lexer::Lexer(const std::string& source) : source(source), current(0), start(0), line(1), column(1) {}
+constexpr bool isPerfectSeed(uint32_t seed) {
+    bool used[keywordTableSize] = {};
+    for (const Keyword& keyword : keywordList) {
+        uint32_t slot = keywordHash(keyword.text, seed);
+        if (used[slot]) return false;
+        used[slot] = true;
+    }
+    return true;
+}
 
-std::vector<Token> Lexer::scanTokens() {
-    std::vector<Token> result;
-    while (!isAtEnd()) {
-        start = current;
-        scanNextToken();
-        if (!tokens.empty()) {
-            result.push_back(tokens.back());
-            tokens.pop_back();
-        }
+constexpr uint32_t findKeywordSeed() {
+    for (uint32_t seed = 2166136261u; seed < 2166136261u + 100000u; seed++) {
+        if (isPerfectSeed(seed)) return seed;
     }
-    result.emplace_back(TokenType::END_OF_FILE, "", line, column);
-    return result;
+    return 0;
 }
 
-Token Lexer::scanToken() {
-    if (isAtEnd()) {
-        return Token(TokenType::END_OF_FILE, "", line, column);
+constexpr uint32_t keywordSeed = findKeywordSeed();
+static_assert(keywordSeed != 0, "no perfect hash seed found for the keyword set");
+
+struct KeywordTable {
+    Keyword slots[keywordTableSize];
+};
+
+constexpr KeywordTable buildKeywordTable() {
+    KeywordTable table = {};
+    for (size_t i = 0; i < keywordTableSize; i++) {
+        table.slots[i] = {std::string_view(), TokenType::IDENTIFIER};
     }
-    start = current;
-    scanNextToken();
-    if (!tokens.empty()) {
-        Token token = tokens.back();
-        tokens.pop_back();
-        return token;
+    for (const Keyword& keyword : keywordList) {
+        table.slots[keywordHash(keyword.text, keywordSeed)] = keyword;
     }
-    return Token(TokenType::UNKNOWN, "", line, column);
+    return table;
 }
 
-bool Lexer::isAtEnd() const {
-    return current >= source.length();
+constexpr KeywordTable keywordTable = buildKeywordTable();
+
+constexpr TokenType lookupKeyword(std::string_view text) {
+    const Keyword& slot = keywordTable.slots[keywordHash(text, keywordSeed)];
+    return slot.text == text ? slot.type : TokenType::IDENTIFIER;
 }
 
-void Lexer::addToken(TokenType type, const std::string& value) {
-    tokens.emplace_back(type, value, line, column);
+static_assert(lookupKeyword("screenit") == TokenType::KW_SCREENIT, "keyword table is broken");
+static_assert(lookupKeyword("whilst") == TokenType::IDENTIFIER, "keyword table is broken");
+
+// ---- Scanner DFA -------------------------------------------------------------
+//
+// Tokens are recognised by a deterministic automaton whose tables are built at
+// compile time. Every byte maps to a character class; the transition table maps
+// (state, class) to the next state. The scan loop takes transitions until it
+// reaches a stop state and emits the token for the state it stopped in
+// (maximal munch), so a token costs one table load per byte and no locale calls.
+// Blanks, comments and string literals are stop states as well: their bodies
+// are skipped by the SIMD kernels instead of byte by byte.
+
+enum CharClass : uint8_t {
+    CC_OTHER, CC_BLANK, CC_NEWLINE, CC_LETTER, CC_DIGIT, CC_DOT, CC_QUOTE, CC_SLASH,
+    CC_EQUAL, CC_BANG, CC_LESS, CC_GREATER, CC_PLUS, CC_MINUS, CC_STAR,
+    CC_LPAREN, CC_RPAREN, CC_LBRACE, CC_RBRACE, CC_SEMICOLON, CC_COMMA,
+    CC_EOF,
+    CC_COUNT
+};
+
+enum State : uint8_t {
+    // Live states: the scan continues from these.
+    S_START, S_IDENT, S_INT, S_INT_DOT, S_FLOAT, S_SLASH, S_EQUAL, S_BANG, S_LESS, S_GREATER,
+    S_SINGLE,   // any complete one- or two-character token; every transition stops
+    S_LIVE_COUNT,
+    // Stop states: the scan loop exits when it reaches one of these.
+    S_DONE = S_LIVE_COUNT,  // emit the token for the state the scan stopped in
+    S_BLANK,                // run of blanks (S_START only)
+    S_COMMENT,              // "//" seen
+    S_STRING,               // opening quote seen (S_START only)
+    S_STATE_COUNT
+};
+
+struct CharClassTable {
+    uint8_t classes[256];
+};
+
+constexpr CharClassTable buildCharClasses() {
+    CharClassTable table = {};
+    for (int c = 'a'; c <= 'z'; c++) table.classes[c] = CC_LETTER;
+    for (int c = 'A'; c <= 'Z'; c++) table.classes[c] = CC_LETTER;
+    for (int c = '0'; c <= '9'; c++) table.classes[c] = CC_DIGIT;
+    table.classes[static_cast<unsigned char>('_')] = CC_LETTER;
+    table.classes[static_cast<unsigned char>(' ')] = CC_BLANK;
+    table.classes[static_cast<unsigned char>('\t')] = CC_BLANK;
+    table.classes[static_cast<unsigned char>('\r')] = CC_BLANK;
+    table.classes[static_cast<unsigned char>('\n')] = CC_NEWLINE;
+    table.classes[static_cast<unsigned char>('.')] = CC_DOT;
+    table.classes[static_cast<unsigned char>('"')] = CC_QUOTE;
+    table.classes[static_cast<unsigned char>('/')] = CC_SLASH;
+    table.classes[static_cast<unsigned char>('=')] = CC_EQUAL;
+    table.classes[static_cast<unsigned char>('!')] = CC_BANG;
+    table.classes[static_cast<unsigned char>('<')] = CC_LESS;
+    table.classes[static_cast<unsigned char>('>')] = CC_GREATER;
+    table.classes[static_cast<unsigned char>('+')] = CC_PLUS;
+    table.classes[static_cast<unsigned char>('-')] = CC_MINUS;
+    table.classes[static_cast<unsigned char>('*')] = CC_STAR;
+    table.classes[static_cast<unsigned char>('(')] = CC_LPAREN;
+    table.classes[static_cast<unsigned char>(')')] = CC_RPAREN;
+    table.classes[static_cast<unsigned char>('{')] = CC_LBRACE;
+    table.classes[static_cast<unsigned char>('}')] = CC_RBRACE;
+    table.classes[static_cast<unsigned char>(';')] = CC_SEMICOLON;
+    table.classes[static_cast<unsigned char>(',')] = CC_COMMA;
+    return table;
 }
 
-void Lexer::scanNextToken() {
-    char c = advance();
-    switch (c) {
-        case '(': addToken(TokenType::LEFT_PAREN, "("); break;
-        case ')': addToken(TokenType::RIGHT_PAREN, ")"); break;
-        case '{': addToken(TokenType::LEFT_BRACE, "{"); break;
-        case '}': addToken(TokenType::RIGHT_BRACE, "}"); break;
-        case ';': addToken(TokenType::SEMICOLON, ";"); break;
-        case ',': addToken(TokenType::COMMA, ","); break;
-        case '+': addToken(TokenType::ARITHMETIC, "+"); break;
-        case '-': addToken(TokenType::ARITHMETIC, "-"); break;
-        case '*': addToken(TokenType::ARITHMETIC, "*"); break;
-        case '/': 
-            if (match('/')) {
-                // A comment goes until the end of the line.
-                while (peek() != '\n' && !isAtEnd()) advance();
-            } else {
-                addToken(TokenType::ARITHMETIC, "/");
-            }
-            break;
-        case '=':
-            if (match('=')) {
-                addToken(TokenType::COMPARE, "==");
-            } else {
-                addToken(TokenType::OPERATOR, "=");
-            }
-            break;
-        case '!':
-            if (match('=')) {
-                addToken(TokenType::COMPARE, "!=");
-            } else {
-                addToken(TokenType::OPERATOR, "!");
-            }
-            break;
-        case '<':
-            if (match('=')) {
-                addToken(TokenType::COMPARE, "<=");
-            } else {
-                addToken(TokenType::COMPARE, "<");
+constexpr CharClassTable charClasses = buildCharClasses();
+
+struct TransitionTable {
+    uint8_t next[S_LIVE_COUNT][CC_COUNT];
+    // Kind of an S_SINGLE token, indexed by the class of its last byte.
+    TokenType singleKind[CC_COUNT];
+};
+
+constexpr TransitionTable buildTransitions() {
+    TransitionTable table = {};
+    for (int s = 0; s < S_LIVE_COUNT; s++) {
+        for (int c = 0; c < CC_COUNT; c++) table.next[s][c] = S_DONE;
+    }
+    for (int c = 0; c < CC_COUNT; c++) table.next[S_START][c] = S_SINGLE;
+    table.next[S_START][CC_EOF] = S_DONE;
+    table.next[S_START][CC_BLANK] = S_BLANK;
+    table.next[S_START][CC_NEWLINE] = S_BLANK;
+    table.next[S_START][CC_QUOTE] = S_STRING;
+    table.next[S_START][CC_LETTER] = S_IDENT;
+    table.next[S_START][CC_DIGIT] = S_INT;
+    table.next[S_START][CC_SLASH] = S_SLASH;
+    table.next[S_START][CC_EQUAL] = S_EQUAL;
+    table.next[S_START][CC_BANG] = S_BANG;
+    table.next[S_START][CC_LESS] = S_LESS;
+    table.next[S_START][CC_GREATER] = S_GREATER;
+
+    table.next[S_IDENT][CC_LETTER] = S_IDENT;
+    table.next[S_IDENT][CC_DIGIT] = S_IDENT;
+    table.next[S_INT][CC_DIGIT] = S_INT;
+    table.next[S_INT][CC_DOT] = S_INT_DOT;
+    table.next[S_INT_DOT][CC_DIGIT] = S_FLOAT;
+    table.next[S_FLOAT][CC_DIGIT] = S_FLOAT;
+    table.next[S_SLASH][CC_SLASH] = S_COMMENT;
+    table.next[S_EQUAL][CC_EQUAL] = S_SINGLE;
+    table.next[S_BANG][CC_EQUAL] = S_SINGLE;
+    table.next[S_LESS][CC_EQUAL] = S_SINGLE;
+    table.next[S_GREATER][CC_EQUAL] = S_SINGLE;
+
+    for (int c = 0; c < CC_COUNT; c++) table.singleKind[c] = TokenType::UNKNOWN;
+    table.singleKind[CC_LPAREN] = TokenType::LEFT_PAREN;
+    table.singleKind[CC_RPAREN] = TokenType::RIGHT_PAREN;
+    table.singleKind[CC_LBRACE] = TokenType::LEFT_BRACE;
+    table.singleKind[CC_RBRACE] = TokenType::RIGHT_BRACE;
+    table.singleKind[CC_SEMICOLON] = TokenType::SEMICOLON;
+    table.singleKind[CC_COMMA] = TokenType::COMMA;
+    table.singleKind[CC_PLUS] = TokenType::ARITHMETIC;
+    table.singleKind[CC_MINUS] = TokenType::ARITHMETIC;
+    table.singleKind[CC_STAR] = TokenType::ARITHMETIC;
+    // Second byte of "==", "!=", "<=" and ">=".
+    table.singleKind[CC_EQUAL] = TokenType::COMPARE;
+    return table;
+}
+
+constexpr TransitionTable transitions = buildTransitions();
+
+// Kind emitted when the scan stops in a live state. S_START only stops at the
+// end of input, S_INT_DOT backs up one byte, and S_IDENT and S_SINGLE take
+// their kind from the keyword table and singleKind.
+constexpr TokenType acceptKind[S_LIVE_COUNT] = {
+    TokenType::END_OF_FILE,    // S_START
+    TokenType::IDENTIFIER,     // S_IDENT
+    TokenType::INT_LITERAL,    // S_INT
+    TokenType::INT_LITERAL,    // S_INT_DOT
+    TokenType::FLOAT_LITERAL,  // S_FLOAT
+    TokenType::ARITHMETIC,     // S_SLASH
+    TokenType::OPERATOR,       // S_EQUAL
+    TokenType::OPERATOR,       // S_BANG
+    TokenType::COMPARE,        // S_LESS
+    TokenType::COMPARE,        // S_GREATER
+    TokenType::UNKNOWN,        // S_SINGLE
+};
+
+} // namespace
+
+Lexer::Lexer(std::string_view source) : source(source), current(0), start(0), line(1), lineStart(0) {
+    if (source.size() > UINT32_MAX) {
+        throw std::runtime_error("Source file too large (token offsets are 32-bit).");
+    }
+}
+
+std::vector<Token> Lexer::scanTokens() {
+    tokens.clear();
+    // Dense code runs at about one token per two bytes. Reserving that up front
+    // keeps reallocation out of the emit path; capacity that is never written
+    // only costs address space.
+    tokens.reserve(source.size() / 2 + 16);
+    scanRange(0, source.size(), 1, 0);
+    start = current;
+    addToken(TokenType::END_OF_FILE);
+    return std::move(tokens);
+}
+
+namespace {
+
+// Result of lexing one chunk speculatively, as if a lexeme started at its
+// first byte on line 1.
+struct ChunkResult {
+    std::vector<Token> tokens;
+    size_t end = 0;        // where the scan stopped; a token may run past the chunk
+    size_t line = 1;       // chunk-relative line at `end`
+    size_t lineStart = 0;
+    size_t newlines = 0;   // '\n' bytes inside the chunk itself
+};
+
+// A run of finished tokens to copy into the output, shifted by lineDelta.
+struct TokenSegment {
+    const Token* tokens;
+    size_t count;
+    size_t lineDelta;
+    size_t dest;
+};
+
+} // namespace
+
+std::vector<Token> Lexer::scanTokensParallel(ThreadPool& pool, size_t minChunkBytes) {
+    const char* data = source.data();
+    const size_t size = source.size();
+    size_t chunkCount = std::min(pool.size() * 4, size / std::max<size_t>(minChunkBytes, 1));
+    if (pool.size() < 2 || chunkCount < 2) {
+        return scanTokens();
+    }
+
+    // Chunks begin just past a newline, so a chunk can only start inside a
+    // lexeme when that newline belongs to a string literal.
+    std::vector<size_t> bounds = {0};
+    for (size_t i = 1; i < chunkCount; i++) {
+        size_t newline = simd_scan::findNewline(data, std::max(i * size / chunkCount, bounds.back()), size);
+        if (newline + 1 >= size) break;
+        bounds.push_back(newline + 1);
+    }
+    bounds.push_back(size);
+    const size_t chunks = bounds.size() - 1;
+
+    std::vector<ChunkResult> results(chunks);
+    std::vector<std::future<void>> pending;
+    pending.reserve(chunks);
+    for (size_t i = 0; i < chunks; i++) {
+        pending.push_back(pool.submit([this, data, &bounds, &results, i]() {
+            Lexer chunkLexer(source);
+            chunkLexer.tokens.reserve((bounds[i + 1] - bounds[i]) / 2 + 16);
+            chunkLexer.scanRange(bounds[i], bounds[i + 1], 1, bounds[i]);
+            ChunkResult& result = results[i];
+            result.tokens = std::move(chunkLexer.tokens);
+            result.end = chunkLexer.current;
+            result.line = chunkLexer.line;
+            result.lineStart = chunkLexer.lineStart;
+            result.newlines = static_cast<size_t>(std::count(data + bounds[i], data + bounds[i + 1], '\n'));
+        }));
+    }
+    for (std::future<void>& task : pending) task.get();
+
+    // Stitch the chunks in order. `pos`, `curLine` and `curLineStart` track
+    // where the serial lexer would be.
+    std::deque<std::vector<Token>> relexed;
+    std::vector<TokenSegment> segments;
+    size_t total = 0;
+    size_t pos = 0;
+    size_t curLine = 1;
+    size_t curLineStart = 0;
+    size_t linesBefore = 0;
+    for (size_t i = 0; i < chunks; i++) {
+        const ChunkResult& chunk = results[i];
+        const size_t lineDelta = linesBefore;
+        linesBefore += chunk.newlines;
+        if (pos >= bounds[i + 1]) {
+            continue;  // entirely inside a token that started in an earlier chunk
+        }
+
+        size_t first = 0;
+        if (pos > bounds[i]) {
+            // A string literal ran across the boundary, so this chunk's scan
+            // started mid-token. Lex serially from the real position until a
+            // token lines up with one the chunk lexer produced; from a shared
+            // lexeme start on, both scans are identical.
+            Lexer fixup(source);
+            fixup.current = pos;
+            fixup.line = curLine;
+            fixup.lineStart = curLineStart;
+            bool synced = false;
+            while (fixup.current < chunk.end && !synced) {
+                size_t emitted = fixup.tokens.size();
+                fixup.scanNextToken();
+                if (fixup.tokens.size() == emitted) continue;
+                const Token& token = fixup.tokens.back();
+                auto match = std::lower_bound(chunk.tokens.begin(), chunk.tokens.end(), token.offset,
+                    [](const Token& t, uint32_t offset) { return t.offset < offset; });
+                if (match != chunk.tokens.end() && match->offset == token.offset &&
+                    match->type == token.type && match->length == token.length) {
+                    fixup.tokens.pop_back();
+                    first = static_cast<size_t>(match - chunk.tokens.begin());
+                    synced = true;
+                }
             }
-            break;
-        case '>':
-            if (match('=')) {
-                addToken(TokenType::COMPARE, ">=");
-            } else {
-                addToken(TokenType::COMPARE, ">");
+            relexed.push_back(std::move(fixup.tokens));
+            segments.push_back({relexed.back().data(), relexed.back().size(), 0, total});
+            total += relexed.back().size();
+            if (!synced) {
+                pos = fixup.current;
+                curLine = fixup.line;
+                curLineStart = fixup.lineStart;
+                continue;
             }
-            break;
-        case ' ': case '\r': case '\t': break;
-        case '\n': line++; column = 1; break;
-        case '"': string(); break;
-        default:
-            if (isDigit(c)) {
-                number();
-            } else if (isAlpha(c)) {
-                identifier();
-            } else {
-                addToken(TokenType::UNKNOWN, std::string(1, c));
+        }
+
+        segments.push_back({chunk.tokens.data() + first, chunk.tokens.size() - first, lineDelta, total});
+        total += chunk.tokens.size() - first;
+        pos = chunk.end;
+        curLine = chunk.line + lineDelta;
+        curLineStart = chunk.lineStart;
+    }
+
+    tokens.clear();
+    tokens.resize(total, Token(TokenType::UNKNOWN, 0, 0, 0, 0));
+    pending.clear();
+    for (const TokenSegment& segment : segments) {
+        pending.push_back(pool.submit([this, segment]() {
+            Token* out = tokens.data() + segment.dest;
+            for (size_t k = 0; k < segment.count; k++) {
+                out[k] = segment.tokens[k];
+                out[k].line += static_cast<uint32_t>(segment.lineDelta);
             }
-            break;
+        }));
     }
+    for (std::future<void>& task : pending) task.get();
+
+    current = size;
+    line = curLine;
+    lineStart = curLineStart;
+    start = current;
+    addToken(TokenType::END_OF_FILE);
+    return std::move(tokens);
 }
 
-char Lexer::advance() {
-    return source[current++];
+Token Lexer::scanToken() {
+    // Blanks and comments emit nothing, so keep scanning until a lexeme does.
+    while (tokens.empty()) {
+        if (isAtEnd()) {
+            start = current;
+            addToken(TokenType::END_OF_FILE);
+        } else {
+            scanNextToken();
+        }
+    }
+    Token token = tokens.back();
+    tokens.pop_back();
+    return token;
 }
 
-bool Lexer::match(char expected) {
-    if (isAtEnd() || source[current] != expected) return false;
-    current++;
-    return true;
+namespace {
+
+// Lexeme bounds of a token: string literal tokens exclude their quotes.
+size_t lexemeStart(const Token& token) {
+    return token.offset - (token.type == TokenType::STRING_LITERAL ? 1 : 0);
 }
 
-char Lexer::peek() const {
-    if (isAtEnd()) return '\0';
-    return source[current];
+size_t lexemeEnd(const Token& token) {
+    return token.offset + token.length + (token.type == TokenType::STRING_LITERAL ? 1 : 0);
 }
 
-char Lexer::peekNext() const {
-    if (current + 1 >= source.length()) return '\0';
-    return source[current + 1];
+size_t lineStartBefore(std::string_view source, size_t pos) {
+    size_t newline = source.find_last_of('\n', pos == 0 ? 0 : pos - 1);
+    return (pos == 0 || newline == std::string_view::npos) ? 0 : newline + 1;
 }
 
-void Lexer::string() {
-    while (peek() != '"' && !isAtEnd()) {
-        if (peek() == '\n') line++;
-        advance();
+} // namespace
+
+TokenChange Lexer::relex(std::vector<Token>& oldTokens, const SourceEdit& edit) {
+    const size_t oldEditEnd = edit.offset + edit.removedLength;
+    const size_t newEditEnd = edit.offset + edit.insertedLength;
+    const int64_t delta = static_cast<int64_t>(edit.insertedLength) - static_cast<int64_t>(edit.removedLength);
+
+    // The scan of a token reads at most two bytes past its end ("1." followed
+    // by a non-digit), so tokens ending two or more bytes before the edit are
+    // unaffected. Restart where the serial lexer stood after the last of them.
+    size_t first = static_cast<size_t>(std::partition_point(oldTokens.begin(), oldTokens.end(),
+        [&](const Token& t) {
+            return t.type != TokenType::END_OF_FILE && lexemeEnd(t) + 2 <= edit.offset;
+        }) - oldTokens.begin());
+
+    tokens.clear();
+    current = 0;
+    line = 1;
+    if (first > 0) {
+        const Token& prev = oldTokens[first - 1];
+        current = lexemeEnd(prev);
+        line = prev.line + static_cast<size_t>(std::count(source.begin() + lexemeStart(prev),
+                                                          source.begin() + current, '\n'));
     }
-    if (isAtEnd()) {
-        addToken(TokenType::UNKNOWN, "Unterminated string.");
-        return;
+    lineStart = lineStartBefore(source, current);
+
+    // Relex until a new token matches an old token (shifted by `delta`) that
+    // starts after the edit: from a shared lexeme start on, both scans agree.
+    size_t oldIndex = first;
+    size_t match = oldTokens.size();
+    for (;;) {
+        size_t emitted = tokens.size();
+        if (isAtEnd()) {
+            start = current;
+            addToken(TokenType::END_OF_FILE);
+        } else {
+            scanNextToken();
+            if (tokens.size() == emitted) continue;
+        }
+        const Token& token = tokens.back();
+        if (lexemeStart(token) >= newEditEnd) {
+            int64_t oldOffset = static_cast<int64_t>(token.offset) - delta;
+            while (oldIndex < oldTokens.size() &&
+                   (lexemeStart(oldTokens[oldIndex]) < oldEditEnd ||
+                    static_cast<int64_t>(oldTokens[oldIndex].offset) < oldOffset)) {
+                oldIndex++;
+            }
+            if (oldIndex < oldTokens.size()) {
+                const Token& old = oldTokens[oldIndex];
+                if (static_cast<int64_t>(old.offset) == oldOffset && old.type == token.type &&
+                    old.length == token.length) {
+                    match = oldIndex;
+                    break;
+                }
+            }
+        }
+        if (token.type == TokenType::END_OF_FILE) break;
     }
-    advance(); // The closing ".
-    std::string value = source.substr(start + 1, current - start - 2);
-    addToken(TokenType::STRING_LITERAL, value);
-}
 
-void Lexer::number() {
-    while (isDigit(peek())) advance();
-    if (peek() == '.' && isDigit(peekNext())) {
-        advance();
-        while (isDigit(peek())) advance();
-        addToken(TokenType::FLOAT_LITERAL, source.substr(start, current - start));
+    // Splice: old [first, match) becomes the relexed tokens; the matched token
+    // and everything after it are old tokens moved to their new position.
+    const size_t removed = match - first;
+    const size_t inserted = tokens.size() - (match < oldTokens.size() ? 1 : 0);
+    const Token anchor = tokens.back();
+    const Token oldAnchor = match < oldTokens.size() ? oldTokens[match] : anchor;
+    if (inserted > removed) {
+        oldTokens.insert(oldTokens.begin() + match, inserted - removed, anchor);
     } else {
-        addToken(TokenType::INT_LITERAL, source.substr(start, current - start));
+        oldTokens.erase(oldTokens.begin() + first + inserted, oldTokens.begin() + match);
+    }
+    std::copy(tokens.begin(), tokens.begin() + inserted, oldTokens.begin() + first);
+
+    // Shift the tail. Lines move by a constant; columns only change for the
+    // tokens that share the anchor's line, since the edit happened before them.
+    const int64_t lineDelta = static_cast<int64_t>(anchor.line) - static_cast<int64_t>(oldAnchor.line);
+    const size_t anchorLineStart = lineStartBefore(source, lexemeStart(anchor));
+    bool sameLine = true;
+    for (size_t i = first + inserted; i < oldTokens.size(); i++) {
+        Token& token = oldTokens[i];
+        sameLine = sameLine && token.line == oldAnchor.line;
+        token.offset = static_cast<uint32_t>(token.offset + delta);
+        token.line = static_cast<uint32_t>(token.line + lineDelta);
+        if (sameLine) {
+            token.column = static_cast<uint16_t>(std::min<size_t>(lexemeStart(token) - anchorLineStart + 1, UINT16_MAX));
+        }
     }
+    tokens.clear();
+    return TokenChange{first, removed, inserted};
 }
 
-void Lexer::identifier() {
-    while (isAlphaNumeric(peek())) advance();
-    std::string text = source.substr(start, current - start);
-    auto it = keywords.find(text);
-    if (it != keywords.end()) {
-        addToken(it->second, text);
-    } else {
-        addToken(TokenType::IDENTIFIER, text);
+void Lexer::seek(const Token& token) {
+    current = lexemeStart(token);
+    line = token.line;
+    // Columns saturate on very long lines; only then search for the line start.
+    lineStart = token.column < UINT16_MAX ? current - (token.column - 1) : lineStartBefore(source, current);
+}
+
+bool Lexer::isAtEnd() const {
+    return current >= source.length();
+}
+
+// Scans lexemes from `begin` until `current` reaches `end`; the last lexeme
+// may extend past `end`.
+void Lexer::scanRange(size_t begin, size_t end, size_t startLine, size_t startLineStart) {
+    current = begin;
+    line = startLine;
+    lineStart = startLineStart;
+    while (current < end) {
+        scanNextToken();
     }
 }
 
-bool Lexer::isDigit(char c) const {
-    return std::isdigit(c);
+void Lexer::addToken(TokenType type) {
+    addToken(type, start, current - start);
 }
 
-bool Lexer::isAlpha(char c) const {
-    return std::isalpha(c) || c == '_';
+void Lexer::addToken(TokenType type, size_t offset, size_t length) {
+    size_t column = start - lineStart + 1;
+    tokens.emplace_back(type, static_cast<uint32_t>(offset), static_cast<uint32_t>(length),
+                        static_cast<uint32_t>(line),
+                        static_cast<uint16_t>(std::min<size_t>(column, UINT16_MAX)));
+}
+
+// Scans one lexeme starting at `current`: emits at most one token (blanks and
+// comments emit none) and leaves `current` just past the lexeme.
+void Lexer::scanNextToken() {
+    const char* data = source.data();
+    const size_t end = source.size();
+    start = current;
+
+    uint8_t state = S_START;
+    size_t pos = start;
+    for (;;) {
+        uint8_t cls = pos < end ? charClasses.classes[static_cast<unsigned char>(data[pos])]
+                                : static_cast<uint8_t>(CC_EOF);
+        uint8_t next = transitions.next[state][cls];
+        if (next >= S_DONE) {
+            if (next != S_DONE) state = next;
+            break;
+        }
+        state = next;
+        pos++;
+    }
+
+    switch (state) {
+        case S_BLANK:
+            // Single blanks between tokens are the common case; only longer
+            // runs are worth handing to the bulk kernel.
+            if (data[pos] == '\n') {
+                line++;
+                lineStart = pos + 1;
+            }
+            pos++;
+            if (pos < end) {
+                uint8_t cls = charClasses.classes[static_cast<unsigned char>(data[pos])];
+                if (cls == CC_BLANK || cls == CC_NEWLINE) {
+                    pos = simd_scan::skipBlanks(data, pos, end, line, lineStart);
+                }
+            }
+            current = pos;
+            return;
+        case S_COMMENT:
+            // A comment goes until the end of the line.
+            current = simd_scan::findNewline(data, pos + 1, end);
+            return;
+        case S_STRING:
+            current = pos + 1;
+            string();
+            return;
+        case S_INT_DOT:
+            // "1." not followed by a digit: the dot is not part of the number.
+            current = pos - 1;
+            addToken(TokenType::INT_LITERAL);
+            return;
+        case S_IDENT:
+            current = pos;
+            addToken(lookupKeyword(source.substr(start, pos - start)));
+            return;
+        case S_SINGLE:
+            current = pos;
+            addToken(transitions.singleKind[charClasses.classes[static_cast<unsigned char>(data[pos - 1])]]);
+            return;
+        default:
+            current = pos;
+            addToken(acceptKind[state]);
+            return;
+    }
 }
 
-bool Lexer::isAlphaNumeric(char c) const {
-    return isAlpha(c) || isDigit(c);
+void Lexer::string() {
+    size_t newlines = 0;
+    size_t lastNewline = 0;
+    current = simd_scan::findQuote(source.data(), current, source.size(), newlines, lastNewline);
+    if (isAtEnd()) {
+        // Unterminated string: the UNKNOWN token spans the opening quote and
+        // the rest of the input.
+        addToken(TokenType::UNKNOWN, start, current - start);
+    } else {
+        current++; // The closing ".
+        // The token spans the contents only, without the surrounding quotes.
+        addToken(TokenType::STRING_LITERAL, start + 1, current - start - 2);
+    }
+    // Tokens carry their starting line, so the string's newlines count after it.
+    if (newlines) {
+        line += newlines;
+        lineStart = lastNewline + 1;
+    }
 }
@@ -1,6 +1,5 @@
 #include <dlfcn.h>
 #include <iostream>
-#include <fstream>
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
 #include <llvm/ExecutionEngine/GenericValue.h>
 #include <llvm/ExecutionEngine/MCJIT.h>
@@ -8,8 +7,13 @@
 #include <llvm/Support/DynamicLibrary.h>
 #include <llvm/Support/CodeGen.h>
 #include <filesystem>
+#include <string_view>
+#include "../include/source_buffer.h"
 #include "../include/lexer.h"
+#include "../include/thread_pool.h"
+#include "../include/arena.h"
 #include "../include/parser.h"
+#include "../include/ast_cache.h"
 #include "../include/ir_generator.h"
 
 // Function pointer types
@@ -18,10 +22,25 @@ typedef void (*ScreenitIntFunc)(int);
 typedef void (*ScreenitDoubleFunc)(double);
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <source_file>" << std::endl;
+    // --stream: parse, lower and free one top-level statement at a time
+    // --memoize: cache the results of pure recursive integer functions
+    // --tokens: also lex the whole source up front and dump the tokens
+    bool stream = false;
+    bool memoize = false;
+    bool dumpTokens = false;
+    bool usage = argc < 2;
+    for (int i = 1; i < argc - 1; i++) {
+        std::string_view flag = argv[i];
+        if (flag == "--stream") stream = true;
+        else if (flag == "--memoize") memoize = true;
+        else if (flag == "--tokens") dumpTokens = true;
+        else usage = true;
+    }
+    if (usage) {
+        std::cerr << "Usage: " << argv[0] << " [--stream] [--memoize] [--tokens] <source_file | ->" << std::endl;
         return 1;
     }
+    const char* path = argv[argc - 1];
 
     std::cerr << "Starting compilation..." << std::endl;
 
@@ -64,37 +83,97 @@ int main(int argc, char* argv[]) {
     llvm::sys::DynamicLibrary::AddSymbol("screenit_double", (void*)screenit_double);
     std::cerr << "Registered screenit functions with JIT" << std::endl;
 
-    // Read source file
-    std::ifstream file(argv[1]);
-    if (!file.is_open()) {
-        std::cerr << "Failed to open file: " << argv[1] << std::endl;
+    // Read source file (memory-mapped when possible, "-" reads stdin)
+    SourceBuffer buffer;
+    try {
+        buffer = SourceBuffer::fromFile(path);
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
         return 1;
     }
-    std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-    std::cerr << "Read source file: " << argv[1] << std::endl;
+    std::string_view source = buffer.view();
+    std::cerr << "Read source file: " << path << (buffer.isMapped() ? " (mapped)" : "") << std::endl;
     std::cerr << "Source content:\n" << source << "\n" << std::endl;
 
-    // Lexical analysis
-    Lexer lexer(source);
-    std::vector<Token> tokens = lexer.scanTokens();
-    std::cerr << "Lexical analysis complete. Tokens:" << std::endl;
-    for (const auto& token : tokens) {
-        std::cerr << "  " << token.toString() << std::endl;
+    // The parser pulls its tokens from the lexer as it goes, so there is no
+    // token list to show unless one is asked for (the playground's Lexer
+    // panel does); this pass is extra work the compile itself does not use.
+    if (dumpTokens) {
+        std::cerr << "Lexical analysis complete. Tokens:" << std::endl;
+        for (const Token& token : Lexer(source).scanTokens()) {
+            std::cerr << "  " << token.toString(source) << std::endl;
+        }
+        std::cerr << std::endl;
     }
-    std::cerr << std::endl;
 
-    // Parsing
-    Parser parser(tokens);
-    std::vector<std::unique_ptr<Stmt>> statements = parser.parse();
-    std::cerr << "Parsing complete. Statements:" << std::endl;
-    for (const auto& stmt : statements) {
-        std::cerr << "  " << stmt->toString() << std::endl;
+    // An unchanged source seen before is loaded from the AST cache without
+    // lexing or parsing. Otherwise, for small inputs or a single core, lexing
+    // and parsing run interleaved, the parser pulling tokens from the lexer as
+    // it needs them; large inputs on several cores are lexed in parallel
+    // chunks and their top-level functions parsed in parallel. Inputs of
+    // 64 KiB or more are parsed lazily: function bodies are only skipped
+    // here, and parsed during IR generation if something calls them. The AST
+    // lives in `arena` until the IR has been generated.
+    //
+    // With --stream, each top-level statement is instead parsed, lowered to
+    // IR and dropped before the next one is read, so the AST never holds
+    // more than the largest statement besides the function definitions,
+    // which wait for their first call. That mode parses eagerly and skips
+    // the cache, both of which need the whole program's AST.
+    IRGenerator generator(source);
+    generator.memoizePureFunctions(memoize);
+    std::unique_ptr<llvm::Module> module;
+    Arena arena;
+    // Syntax, name and type errors are reported here; the web playground
+    // shows stderr when the compiler exits non-zero.
+    try {
+        if (stream) {
+            Lexer lexer(source);
+            Parser parser(lexer, source, arena);
+            std::cerr << "Streaming compile. Statements:" << std::endl;
+            Stmt* stmt;
+            while (parser.next(stmt)) {
+                std::cerr << "  " << (stmt ? stmt->toString(source) : "null") << std::endl;
+                generator.add(stmt);
+                arena.rewind();
+            }
+            std::cerr << std::endl;
+            module = generator.finish();
+        } else {
+            AstCache cache = AstCache::fromEnvironment();
+            std::vector<Stmt*> statements;
+            if (std::optional<std::vector<Stmt*>> cached = cache.load(source, arena)) {
+                statements = std::move(*cached);
+                std::cerr << "Loaded AST from cache" << std::endl;
+            } else {
+                Lexer lexer(source);
+                ThreadPool& pool = ThreadPool::shared();
+                bool lazy = source.size() >= 64 * 1024;
+                if (pool.size() > 1 && source.size() >= 1024 * 1024) {
+                    std::vector<Token> tokens = lexer.scanTokensParallel(pool);
+                    statements = Parser::parseParallel(tokens, source, arena, pool, 16 * 1024, lazy);
+                } else {
+                    Parser parser(lexer, source, arena);
+                    parser.deferFunctionBodies(lazy);
+                    statements = parser.parse();
+                }
+                cache.store(source, statements);
+            }
+            std::cerr << "Parsing complete. Statements:" << std::endl;
+            for (const auto& stmt : statements) {
+                std::cerr << "  " << stmt->toString(source) << std::endl;
+            }
+            std::cerr << std::endl;
+
+            // IR generation
+            module = generator.generate(statements);
+            statements.clear();
+            arena.reset();
+        }
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
     }
-    std::cerr << std::endl;
-
-    // IR generation
-    IRGenerator generator;
-    std::unique_ptr<llvm::Module> module = generator.generate(statements);
     std::cerr << "IR dump:\n";
     module->print(llvm::errs(), nullptr);
     std::cerr << std::endl;
@@ -1,76 +1,310 @@
 #include "../include/parser.h"
 #include "../include/ast.h"
+#include "../include/thread_pool.h"
+#include <algorithm>
+#include <exception>
+#include <future>
 #include <stdexcept>
 #include <iostream>
 
-Parser::Parser(const std::vector<Token>& tokens) : tokens(tokens) {}
-
-Token Parser::peek() const {
-    return tokens[current];
+namespace {
+
+// Infix binding powers, keyed by the first byte of the operator. ARITHMETIC
+// and COMPARE tokens are told apart by that byte alone.
+struct BindingPowers {
+    uint8_t arithmetic[256] = {};
+    uint8_t compare[256] = {};
+};
+
+constexpr BindingPowers buildBindingPowers() {
+    BindingPowers table;
+    table.arithmetic['+'] = table.arithmetic['-'] = BP_SUM;
+    table.arithmetic['*'] = table.arithmetic['/'] = BP_PRODUCT;
+    table.compare['='] = table.compare['!'] = BP_EQUALITY;
+    table.compare['<'] = table.compare['>'] = BP_RELATIONAL;
+    return table;
 }
 
-Token Parser::advance() {
-    if (!isAtEnd()) current++;
-    return tokens[current - 1];
-}
+constexpr BindingPowers bindingPowers = buildBindingPowers();
 
-bool Parser::check(TokenType type) const {
-    if (isAtEnd()) return false;
-    return peek().type == type;
-}
+} // namespace
 
-bool Parser::match(TokenType type) {
-    if (check(type)) {
-        advance();
-        return true;
-    }
-    return false;
-}
+Parser::Parser(Lexer& lexer, std::string_view source, Arena& arena)
+    : tokens(lexer), source(source), arena(arena), names(Interner::shared()) {}
 
-bool Parser::isAtEnd() const {
-    return peek().type == TokenType::END_OF_FILE;
-}
+Parser::Parser(const std::vector<Token>& tokens, std::string_view source, Arena& arena)
+    : tokens(tokens), source(source), arena(arena), names(Interner::shared()) {}
 
 Token Parser::consume(TokenType type, const std::string& message) {
     if (check(type)) return advance();
     throw std::runtime_error(message);
 }
 
-std::vector<std::unique_ptr<Stmt>> Parser::parse() {
-    std::vector<std::unique_ptr<Stmt>> statements;
-    while (!isAtEnd()) {
-        if (peek().type == TokenType::END_OF_FILE) {
-            break;
+std::vector<Stmt*> Parser::parse() {
+    std::vector<Stmt*> statements;
+    Stmt* stmt;
+    while (next(stmt)) statements.push_back(stmt);
+    return statements;
+}
+
+bool Parser::next(Stmt*& stmt) {
+    try {
+        while (!isAtEnd()) {
+            if (peek().type == TokenType::UNKNOWN || peek().length == 0) {
+                advance();
+                continue;
+            }
+            stmt = declaration();
+            return true;
         }
-        if (peek().type == TokenType::UNKNOWN || peek().value.empty()) {
+    } catch (const std::runtime_error&) {
+        // An error caused by running into the end of the input ends the
+        // program quietly; anything else is reported.
+        if (!isAtEnd()) throw;
+    }
+    return false;
+}
+
+void Parser::parseDeclarations(std::vector<Stmt*>& statements, size_t end) {
+    while (!isAtEnd() && tokens.index() < end) {
+        if (peek().type == TokenType::UNKNOWN || peek().length == 0) {
             advance();
             continue;
         }
+        statements.push_back(declaration());
+    }
+}
+
+std::vector<Stmt*> Parser::parseParallel(const std::vector<Token>& tokens, std::string_view source,
+                                         Arena& arena, ThreadPool& pool, size_t minChunkTokens,
+                                         bool deferBodies) {
+    // Pre-scan: a `func` keyword outside all braces starts a top-level
+    // declaration, which runs to the brace matching its body's '{'. Chunks
+    // are cut at such keywords once they hold enough tokens.
+    const size_t eof = tokens.size() - 1;
+    const size_t chunkTokens = std::max(minChunkTokens, tokens.size() / (pool.size() * 4));
+    std::vector<size_t> bounds{0};
+    size_t depth = 0;
+    for (size_t i = 0; i < eof; i++) {
+        switch (tokens[i].type) {
+            case TokenType::LEFT_BRACE: depth++; break;
+            case TokenType::RIGHT_BRACE: if (depth > 0) depth--; break;
+            case TokenType::KW_FUNC:
+                if (depth == 0 && i - bounds.back() >= chunkTokens) bounds.push_back(i);
+                break;
+            default: break;
+        }
+    }
+    bounds.push_back(eof);
+    if (bounds.size() <= 2 || pool.size() <= 1) {
+        Parser parser(tokens, source, arena);
+        parser.deferFunctionBodies(deferBodies);
+        return parser.parse();
+    }
+
+    // Each chunk is parsed into its own arena. In a program that parses, no
+    // statement crosses a cut: a `func` outside braces can only start a
+    // declaration, and that declaration ends at its matching brace. A chunk
+    // that does not end exactly at its cut counts as a failure.
+    struct Chunk {
+        Arena arena;
+        std::vector<Stmt*> statements;
+    };
+    std::vector<std::future<std::unique_ptr<Chunk>>> pending;
+    for (size_t c = 0; c + 1 < bounds.size(); c++) {
+        size_t begin = bounds[c];
+        size_t end = bounds[c + 1];
+        pending.push_back(pool.submit([&tokens, source, begin, end, deferBodies]() {
+            auto chunk = std::make_unique<Chunk>();
+            Parser parser(tokens, source, chunk->arena);
+            parser.deferFunctionBodies(deferBodies);
+            parser.tokens = TokenStream(tokens, begin);
+            parser.parseDeclarations(chunk->statements, end);
+            if (parser.tokens.index() != end) {
+                throw std::runtime_error("Declaration crosses a chunk boundary.");
+            }
+            return chunk;
+        }));
+    }
+
+    // Wait for every chunk before deciding anything: they all read `tokens`.
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    bool failed = false;
+    std::exception_ptr fatal;
+    for (auto& result : pending) {
         try {
-            statements.push_back(declaration());
-        } catch (const std::runtime_error& e) {
-            if (isAtEnd()) break;
-            throw;
+            chunks.push_back(result.get());
+        } catch (const std::runtime_error&) {
+            failed = true;
+        } catch (...) {
+            if (!fatal) fatal = std::current_exception();
         }
     }
+    if (fatal) std::rethrow_exception(fatal);
+    // A syntax error anywhere: reparse serially so the outcome (the error,
+    // or the quiet stop at the end of the input) is exactly the serial one.
+    if (failed) {
+        Parser parser(tokens, source, arena);
+        parser.deferFunctionBodies(deferBodies);
+        return parser.parse();
+    }
+
+    std::vector<Stmt*> statements;
+    for (auto& chunk : chunks) {
+        statements.insert(statements.end(), chunk->statements.begin(), chunk->statements.end());
+        arena.adopt(chunk->arena);
+    }
     return statements;
 }
 
-std::unique_ptr<Stmt> Parser::declaration() {
-    if (match(TokenType::KEYWORD)) {
-        Token keyword = tokens[current - 1];
-        if (keyword.value == "func") {
-            return functionDeclaration();
+Stmt* Parser::declaration() {
+    return parseStatement(true);
+}
+
+Stmt* Parser::statement() {
+    return parseStatement(false);
+}
+
+// Parses one statement (or declaration, if `allowDeclaration`). Compound
+// statements push a frame and the loop goes on to their first child; each
+// finished statement is then folded into the frames above it, closing every
+// frame it completes, until one finishes at the level we started from.
+Stmt* Parser::parseStatement(bool allowDeclaration) {
+    const size_t root = stmtFrames.size();
+    bool declaration = allowDeclaration;
+    for (;;) {
+        Stmt* stmt = nullptr;
+        bool complete = openStatement(declaration, stmt);
+        for (;;) {
+            if (complete) {
+                if (stmtFrames.size() == root) return stmt;
+                StmtFrame& frame = stmtFrames.back();
+                if (frame.kind == StmtFrame::Then && match(TokenType::KW_ELSE)) {
+                    frame.kind = StmtFrame::Else;
+                    frame.first = stmt;
+                    break;
+                }
+                if (!frame.isList()) {
+                    stmt = closeStatement(frame, stmt);
+                    stmtFrames.pop_back();
+                    continue;
+                }
+                stmtScratch.push_back(stmt);
+            }
+            // The top frame wants its next child, unless it is a list that ends here.
+            const StmtFrame& frame = stmtFrames.back();
+            if (!frame.isList() || (!check(TokenType::RIGHT_BRACE) && !isAtEnd())) break;
+            stmt = closeList(frame);
+            stmtFrames.pop_back();
+            complete = true;
         }
-        if (keyword.value == "var") {
-            return varDeclaration();
+        declaration = stmtFrames.back().isList();
+    }
+}
+
+bool Parser::openStatement(bool allowDeclaration, Stmt*& stmt) {
+    switch (peek().type) {
+        case TokenType::KW_FUNC:
+            if (!allowDeclaration) break;
+            advance();
+            if (FunctionStmt* function = functionDeclaration(); !function->deferred) {
+                stmtFrames.push_back({StmtFrame::Function});
+                stmtFrames.back().function = function;
+                stmtFrames.back().base = stmtScratch.size();
+                return false;
+            } else {
+                stmt = function;
+                return true;
+            }
+        case TokenType::KW_VAR:
+            if (!allowDeclaration) break;
+            advance();
+            stmt = varDeclaration();
+            return true;
+        case TokenType::KW_CONST:
+            if (!allowDeclaration) break;
+            advance();
+            stmt = varDeclaration(true);
+            return true;
+        case TokenType::LEFT_BRACE:
+            advance();
+            stmtFrames.push_back({StmtFrame::Block});
+            stmtFrames.back().base = stmtScratch.size();
+            return false;
+        case TokenType::KW_IF:
+            advance();
+            stmtFrames.push_back({StmtFrame::Then, parenthesized("Expected '(' after 'if'.",
+                                                                 "Expected ')' after if condition.")});
+            return false;
+        case TokenType::KW_WHILE:
+            advance();
+            stmtFrames.push_back({StmtFrame::While, parenthesized("Expected '(' after 'while'.",
+                                                                  "Expected ')' after condition.")});
+            return false;
+        case TokenType::KW_FOR:
+            advance();
+            forStatement();
+            return false;
+        case TokenType::KW_SCREENIT: advance(); stmt = screenitStatement(); return true;
+        case TokenType::KW_RETURN: advance(); stmt = returnStatement(); return true;
+        case TokenType::KW_BREAK:
+            advance();
+            if (!match(TokenType::SEMICOLON)) {
+                throw std::runtime_error("Expected ';' after break.");
+            }
+            // Just skip break for now (no-op)
+            stmt = nullptr;
+            return true;
+        case TokenType::KW_ELSE:
+            break;
+        default:
+            stmt = expressionStatement();
+            return true;
+    }
+    // A keyword that cannot start a statement here
+    throw std::runtime_error("Unexpected keyword: " + std::string(text(peek())));
+}
+
+Stmt* Parser::closeStatement(const StmtFrame& frame, Stmt* body) {
+    switch (frame.kind) {
+        case StmtFrame::Then: return arena.make<IfStmt>(frame.condition, body, nullptr);
+        case StmtFrame::Else: return arena.make<IfStmt>(frame.condition, frame.first, body);
+        case StmtFrame::While: return arena.make<WhileStmt>(frame.condition, body);
+        case StmtFrame::For: {
+            if (frame.increment != nullptr) {
+                Stmt* stmts[] = {body, arena.make<ExprStmt>(frame.increment)};
+                body = arena.make<BlockStmt>(arena.copy(stmts, 2));
+            }
+
+            // A missing condition is left null; WhileStmt treats it as always true.
+            body = arena.make<WhileStmt>(frame.condition, body);
+
+            if (frame.first != nullptr) {
+                Stmt* stmts[] = {frame.first, body};
+                body = arena.make<BlockStmt>(arena.copy(stmts, 2));
+            }
+            return body;
         }
-        current--;
+        default: break;
     }
-    return statement();
+    throw std::runtime_error("Parser: not a statement frame");
 }
 
-std::unique_ptr<Stmt> Parser::functionDeclaration() {
+Stmt* Parser::closeList(const StmtFrame& frame) {
+    if (frame.kind == StmtFrame::Function) {
+        if (!match(TokenType::RIGHT_BRACE)) {
+            throw std::runtime_error("Expected '}' after function body.");
+        }
+        frame.function->body = takeList(stmtScratch, frame.base);
+        return frame.function;
+    }
+    if (!match(TokenType::RIGHT_BRACE)) {
+        throw std::runtime_error("Expected '}' after block.");
+    }
+    return arena.make<BlockStmt>(takeList(stmtScratch, frame.base));
+}
+
+FunctionStmt* Parser::functionDeclaration() {
     Token name = consume(TokenType::IDENTIFIER, "Expected function name.");
 
     if (!match(TokenType::LEFT_PAREN)) {
@@ -78,6 +312,7 @@ std::unique_ptr<Stmt> Parser::functionDeclaration() {
     }
 
     std::vector<Token> parameters;
+    std::vector<Symbol> parameterSymbols;
     if (!check(TokenType::RIGHT_PAREN)) {
         do {
             if (parameters.size() >= 255) {
@@ -85,6 +320,7 @@ std::unique_ptr<Stmt> Parser::functionDeclaration() {
             }
 
             parameters.push_back(consume(TokenType::IDENTIFIER, "Expected parameter name."));
+            parameterSymbols.push_back(intern(parameters.back()));
         } while (match(TokenType::COMMA));
     }
 
@@ -96,67 +332,84 @@ std::unique_ptr<Stmt> Parser::functionDeclaration() {
         throw std::runtime_error("Expected '{' before function body.");
     }
 
-    std::vector<std::unique_ptr<Stmt>> body;
+    ArenaList<Token> params = arena.copy(parameters.data(), parameters.size());
+    ArenaList<Symbol> paramSymbols = arena.copy(parameterSymbols.data(), parameterSymbols.size());
+    if (deferBodies) {
+        Token bodyStart = previous();
+        skipBody();
+        return arena.make<FunctionStmt>(name, intern(name), params, paramSymbols, bodyStart);
+    }
+    return arena.make<FunctionStmt>(name, intern(name), params, paramSymbols, ArenaList<Stmt*>{});
+}
+
+ArenaList<Stmt*> Parser::functionBody() {
+    size_t base = stmtScratch.size();
     while (!check(TokenType::RIGHT_BRACE) && !isAtEnd()) {
-        body.push_back(declaration());
+        stmtScratch.push_back(declaration());
     }
 
     if (!match(TokenType::RIGHT_BRACE)) {
         throw std::runtime_error("Expected '}' after function body.");
     }
 
-    return std::make_unique<FunctionStmt>(name, parameters, std::move(body));
+    return takeList(stmtScratch, base);
 }
 
-std::unique_ptr<Stmt> Parser::varDeclaration() {
+// Brace matching only: in a well-formed body the '}' that balances the
+// opening brace is the one functionBody() would stop at.
+void Parser::skipBody() {
+    size_t depth = 1;
+    while (!isAtEnd()) {
+        TokenType type = peek().type;
+        tokens.advance();
+        if (type == TokenType::LEFT_BRACE) {
+            depth++;
+        } else if (type == TokenType::RIGHT_BRACE && --depth == 0) {
+            return;
+        }
+    }
+    throw std::runtime_error("Expected '}' after function body.");
+}
+
+void Parser::parseBody(FunctionStmt* function, std::string_view source, Arena& arena) {
+    if (!function->deferred) return;
+    Lexer lexer(source);
+    lexer.seek(function->bodyStart);
+    Parser parser(lexer, source, arena);
+    parser.advance();  // the '{'
+    function->body = parser.functionBody();
+    function->deferred = false;
+}
+
+Stmt* Parser::varDeclaration(bool constant) {
     Token name = consume(TokenType::IDENTIFIER, "Expected variable name.");
 
-    std::unique_ptr<Expr> initializer = nullptr;
-    if (match(TokenType::OPERATOR) && previous().value == "=") {
+    Expr* initializer = nullptr;
+    if (match(TokenType::OPERATOR) && text(previous()) == "=") {
         initializer = expression();
+    } else if (constant) {
+        throw std::runtime_error("Expected '=' after const name.");
     }
 
     if (!match(TokenType::SEMICOLON)) {
         throw std::runtime_error("Expected ';' after variable declaration.");
     }
 
-    return std::make_unique<VarStmt>(name, std::move(initializer));
-}
-
-std::unique_ptr<Stmt> Parser::statement() {
-    if (match(TokenType::LEFT_BRACE)) return block();
-    if (match(TokenType::KEYWORD)) {
-        Token keyword = previous();
-        if (keyword.value == "if") return ifStatement();
-        if (keyword.value == "while") return whileStatement();
-        if (keyword.value == "for") return forStatement();
-        if (keyword.value == "screenit") return screenitStatement();
-        if (keyword.value == "return") return returnStatement();
-        if (keyword.value == "break") {
-            if (!match(TokenType::SEMICOLON)) {
-                throw std::runtime_error("Expected ';' after break.");
-            }
-            // Just skip break for now (no-op)
-            return nullptr;
-        }
-        // If we get here, we found a keyword but it wasn't handled
-        throw std::runtime_error("Unexpected keyword: " + keyword.value);
-    }
-    return expressionStatement();
+    return arena.make<VarStmt>(name, intern(name), initializer, constant);
 }
 
-std::unique_ptr<Stmt> Parser::screenitStatement() {
+Stmt* Parser::screenitStatement() {
     // Skip the screenit keyword since we already matched it
-    std::unique_ptr<Expr> value = expression();
+    Expr* value = expression();
     if (!match(TokenType::SEMICOLON)) {
         throw std::runtime_error("Expected ';' after screenit value.");
     }
-    return std::make_unique<PrintStmt>(std::move(value));
+    return arena.make<PrintStmt>(value);
 }
 
-std::unique_ptr<Stmt> Parser::returnStatement() {
+Stmt* Parser::returnStatement() {
     Token keyword = previous();
-    std::unique_ptr<Expr> value = nullptr;
+    Expr* value = nullptr;
     if (!check(TokenType::SEMICOLON)) {
         value = expression();
     }
@@ -165,236 +418,201 @@ std::unique_ptr<Stmt> Parser::returnStatement() {
         throw std::runtime_error("Expected ';' after return value.");
     }
 
-    return std::make_unique<ReturnStmt>(keyword, std::move(value));
-}
-
-std::unique_ptr<Stmt> Parser::ifStatement() {
-    if (!match(TokenType::LEFT_PAREN)) {
-        throw std::runtime_error("Expected '(' after 'if'.");
-    }
-    std::unique_ptr<Expr> condition = expression();
-    if (!match(TokenType::RIGHT_PAREN)) {
-        throw std::runtime_error("Expected ')' after if condition.");
-    }
-
-    std::unique_ptr<Stmt> thenBranch = statement();
-    std::unique_ptr<Stmt> elseBranch = nullptr;
-    if (match(TokenType::KEYWORD) && previous().value == "else") {
-        elseBranch = statement();
-    }
-
-    return std::make_unique<IfStmt>(std::move(condition), std::move(thenBranch), std::move(elseBranch));
+    return arena.make<ReturnStmt>(keyword, value);
 }
 
-std::unique_ptr<Stmt> Parser::whileStatement() {
+// The condition of an if or while, with the messages for missing parentheses.
+Expr* Parser::parenthesized(const char* open, const char* close) {
     if (!match(TokenType::LEFT_PAREN)) {
-        throw std::runtime_error("Expected '(' after 'while'.");
+        throw std::runtime_error(open);
     }
-    std::unique_ptr<Expr> condition = expression();
+    Expr* condition = expression();
     if (!match(TokenType::RIGHT_PAREN)) {
-        throw std::runtime_error("Expected ')' after condition.");
+        throw std::runtime_error(close);
     }
-    std::unique_ptr<Stmt> body = statement();
-
-    return std::make_unique<WhileStmt>(std::move(condition), std::move(body));
+    return condition;
 }
 
-std::unique_ptr<Stmt> Parser::forStatement() {
+// Parses the for header and pushes its frame; closeStatement desugars the
+// loop into a while once the body is in.
+void Parser::forStatement() {
     if (!match(TokenType::LEFT_PAREN)) {
         throw std::runtime_error("Expected '(' after 'for'.");
     }
 
-    std::unique_ptr<Stmt> initializer;
+    StmtFrame frame{StmtFrame::For};
     if (match(TokenType::SEMICOLON)) {
-        initializer = nullptr;
-    } else if (match(TokenType::KEYWORD) && previous().value == "var") {
-        initializer = varDeclaration();
+        frame.first = nullptr;
+    } else if (match(TokenType::KW_VAR)) {
+        frame.first = varDeclaration();
     } else {
-        initializer = expressionStatement();
+        frame.first = expressionStatement();
     }
 
-    std::unique_ptr<Expr> condition = nullptr;
     if (!check(TokenType::SEMICOLON)) {
-        condition = expression();
+        frame.condition = expression();
     }
     if (!match(TokenType::SEMICOLON)) {
         throw std::runtime_error("Expected ';' after loop condition.");
     }
 
-    std::unique_ptr<Expr> increment = nullptr;
     if (!check(TokenType::RIGHT_PAREN)) {
-        increment = expression();
+        frame.increment = expression();
     }
     if (!match(TokenType::RIGHT_PAREN)) {
         throw std::runtime_error("Expected ')' after for clauses.");
     }
 
-    std::unique_ptr<Stmt> body = statement();
-
-    if (increment != nullptr) {
-        std::vector<std::unique_ptr<Stmt>> stmts;
-        stmts.push_back(std::move(body));
-        stmts.push_back(std::make_unique<ExprStmt>(std::move(increment)));
-        body = std::make_unique<BlockStmt>(std::move(stmts));
-    }
-
-    if (condition == nullptr) {
-        condition = std::make_unique<LiteralExpr>(Token(TokenType::BOOL_LITERAL, "true", 0, 0));
-    }
-    body = std::make_unique<WhileStmt>(std::move(condition), std::move(body));
-
-    if (initializer != nullptr) {
-        std::vector<std::unique_ptr<Stmt>> stmts;
-        stmts.push_back(std::move(initializer));
-        stmts.push_back(std::move(body));
-        body = std::make_unique<BlockStmt>(std::move(stmts));
-    }
-
-    return body;
+    stmtFrames.push_back(frame);
 }
 
-std::unique_ptr<Stmt> Parser::block() {
-    std::vector<std::unique_ptr<Stmt>> statements;
-
-    while (!check(TokenType::RIGHT_BRACE) && !isAtEnd()) {
-        statements.push_back(declaration());
-    }
-
-    if (!match(TokenType::RIGHT_BRACE)) {
-        throw std::runtime_error("Expected '}' after block.");
-    }
-
-    return std::make_unique<BlockStmt>(std::move(statements));
-}
-
-std::unique_ptr<Stmt> Parser::expressionStatement() {
-    std::unique_ptr<Expr> expr = expression();
+Stmt* Parser::expressionStatement() {
+    Expr* expr = expression();
     if (!match(TokenType::SEMICOLON)) {
         throw std::runtime_error("Expected ';' after expression.");
     }
-    return std::make_unique<ExprStmt>(std::move(expr));
+    return arena.make<ExprStmt>(expr);
 }
 
-std::unique_ptr<Expr> Parser::expression() {
-    return assignment();
+Expr* Parser::expression() {
+    return parseExpression(BP_ASSIGNMENT);
 }
 
-std::unique_ptr<Expr> Parser::assignment() {
-    std::unique_ptr<Expr> expr = comparison();
-
-    if (match(TokenType::OPERATOR) && tokens[current - 1].value == "=") {
-        Token equals = tokens[current - 1];
-        std::unique_ptr<Expr> value = assignment();
-
-        if (auto varExpr = dynamic_cast<VariableExpr*>(expr.get())) {
-            return std::make_unique<AssignExpr>(varExpr->name, std::move(value));
+// Pratt parser: parses a prefix operand, then keeps folding in infix and
+// postfix operators for as long as they bind at least as tightly as the
+// current minimum power. The right operand of a left-associative operator is
+// parsed one level tighter; assignment is right-associative. Every operator
+// still waiting for an operand (or a group, or a call, for its closing
+// parenthesis) sits in a frame on exprFrames, which also carries the minimum
+// power its operand is parsed at.
+Expr* Parser::parseExpression(int minPower) {
+    const size_t root = exprFrames.size();
+    int current = minPower;  // of the innermost open frame, or minPower at the root
+    for (;;) {
+        // Prefix: push frames until an operand is found.
+        Expr* left = nullptr;
+        while (!left) {
+            if (isAtEnd()) {
+                throw std::runtime_error("Expected expression.");
+            }
+            Token token = advance();
+            switch (token.type) {
+                case TokenType::BOOL_LITERAL:
+                case TokenType::INT_LITERAL:
+                case TokenType::FLOAT_LITERAL:
+                case TokenType::STRING_LITERAL:
+                    left = arena.make<LiteralExpr>(token);
+                    break;
+                case TokenType::IDENTIFIER:
+                    left = arena.make<VariableExpr>(token, intern(token));
+                    break;
+                case TokenType::LEFT_PAREN:
+                    exprFrames.push_back({ExprFrame::Grouping, BP_ASSIGNMENT, token, nullptr, 0});
+                    current = BP_ASSIGNMENT;
+                    break;
+                case TokenType::ARITHMETIC:
+                case TokenType::OPERATOR:
+                    if (source[token.offset] == '-' || source[token.offset] == '!') {
+                        exprFrames.push_back({ExprFrame::Unary, BP_PREFIX, token, nullptr, 0});
+                        current = BP_PREFIX;
+                        break;
+                    }
+                    throw std::runtime_error("Expected expression.");
+                default:
+                    throw std::runtime_error("Expected expression.");
+            }
         }
 
-        throw std::runtime_error("Invalid assignment target.");
-    }
-
-    return expr;
-}
-
-std::unique_ptr<Expr> Parser::comparison() {
-    std::unique_ptr<Expr> expr = term();
-
-    while (check(TokenType::COMPARE)) {
-        Token op = advance();
-        std::unique_ptr<Expr> right = term();
-        expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
-    }
-
-    return expr;
-}
-
-std::unique_ptr<Expr> Parser::term() {
-    std::unique_ptr<Expr> expr = factor();
-
-    while (match(TokenType::ARITHMETIC)) {
-        Token op = tokens[current - 1];
-        std::unique_ptr<Expr> right = factor();
-        expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
-    }
-
-    return expr;
-}
-
-std::unique_ptr<Expr> Parser::factor() {
-    std::unique_ptr<Expr> expr = unary();
-
-    while (match(TokenType::ARITHMETIC)) {
-        Token op = tokens[current - 1];
-        std::unique_ptr<Expr> right = unary();
-        expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
-    }
-
-    return expr;
-}
-
-std::unique_ptr<Expr> Parser::unary() {
-    if (match(TokenType::OPERATOR)) {
-        Token op = tokens[current - 1];
-        std::unique_ptr<Expr> right = unary();
-        return std::make_unique<UnaryExpr>(op, std::move(right));
-    }
-
-    return call();
-}
-
-std::unique_ptr<Expr> Parser::call() {
-    std::unique_ptr<Expr> expr = primary();
+        // Infix: fold operators into `left`, or reduce the frame whose
+        // operand `left` completes.
+        for (;;) {
+            Token op = peek();
+            int power = infixPower(op);
+            if (power >= current) {
+                advance();
+                if (power == BP_CALL) {
+                    if (!check(TokenType::RIGHT_PAREN)) {
+                        exprFrames.push_back({ExprFrame::Call, BP_ASSIGNMENT, op, left, exprScratch.size()});
+                        current = BP_ASSIGNMENT;
+                        break;
+                    }
+                    left = finishCall({ExprFrame::Call, BP_ASSIGNMENT, op, left, exprScratch.size()});
+                } else if (power == BP_ASSIGNMENT) {
+                    exprFrames.push_back({ExprFrame::Assign, BP_ASSIGNMENT, op, left, 0});
+                    current = BP_ASSIGNMENT;
+                    break;
+                } else {
+                    exprFrames.push_back({ExprFrame::Binary, static_cast<uint8_t>(power + 1), op, left, 0});
+                    current = power + 1;
+                    break;
+                }
+                continue;
+            }
 
-    while (true) {
-        if (match(TokenType::LEFT_PAREN)) {
-            expr = finishCall(std::move(expr));
-        } else {
-            break;
+            if (exprFrames.size() == root) return left;
+            const ExprFrame& frame = exprFrames.back();
+            switch (frame.kind) {
+                case ExprFrame::Grouping:
+                    if (!match(TokenType::RIGHT_PAREN)) {
+                        throw std::runtime_error("Expected ')' after expression.");
+                    }
+                    left = arena.make<GroupingExpr>(left);
+                    break;
+                case ExprFrame::Unary:
+                    left = arena.make<UnaryExpr>(frame.op, left);
+                    break;
+                case ExprFrame::Binary:
+                    left = arena.make<BinaryExpr>(frame.left, frame.op, left);
+                    break;
+                case ExprFrame::Assign: {
+                    if (frame.left->kind != ExprKind::Variable) {
+                        throw std::runtime_error("Invalid assignment target.");
+                    }
+                    auto varExpr = static_cast<VariableExpr*>(frame.left);
+                    left = arena.make<AssignExpr>(varExpr->name, varExpr->symbol, left);
+                    break;
+                }
+                case ExprFrame::Call:
+                    exprScratch.push_back(left);
+                    if (match(TokenType::COMMA)) {
+                        if (exprScratch.size() - frame.base >= 255) {
+                            throw std::runtime_error("Cannot have more than 255 arguments.");
+                        }
+                        left = nullptr;  // parse the next argument
+                        break;
+                    }
+                    left = finishCall(frame);
+                    break;
+            }
+            if (!left) break;
+            exprFrames.pop_back();
+            current = exprFrames.size() > root ? exprFrames.back().minPower : minPower;
         }
     }
-
-    return expr;
 }
 
-std::unique_ptr<Expr> Parser::primary() {
-    if (match(TokenType::BOOL_LITERAL)) return std::make_unique<LiteralExpr>(previous());
-    if (match(TokenType::INT_LITERAL)) return std::make_unique<LiteralExpr>(previous());
-    if (match(TokenType::FLOAT_LITERAL)) return std::make_unique<LiteralExpr>(previous());
-    if (match(TokenType::STRING_LITERAL)) return std::make_unique<LiteralExpr>(previous());
-
-    if (match(TokenType::IDENTIFIER)) {
-        return std::make_unique<VariableExpr>(previous());
+// Only operator tokens are read from the source: END_OF_FILE starts one
+// past its end.
+int Parser::infixPower(const Token& token) const {
+    auto first = [&] { return static_cast<unsigned char>(source[token.offset]); };
+    switch (token.type) {
+        case TokenType::ARITHMETIC: return bindingPowers.arithmetic[first()];
+        case TokenType::COMPARE: return bindingPowers.compare[first()];
+        case TokenType::OPERATOR: return first() == '=' ? BP_ASSIGNMENT : BP_NONE;
+        case TokenType::LEFT_PAREN: return BP_CALL;
+        default: return BP_NONE;
     }
-
-    if (match(TokenType::LEFT_PAREN)) {
-        std::unique_ptr<Expr> expr = expression();
-        if (!match(TokenType::RIGHT_PAREN)) {
-            throw std::runtime_error("Expected ')' after expression.");
-        }
-        return std::make_unique<GroupingExpr>(std::move(expr));
-    }
-
-    throw std::runtime_error("Expected expression.");
 }
 
-std::unique_ptr<Expr> Parser::finishCall(std::unique_ptr<Expr> callee) {
-    std::vector<std::unique_ptr<Expr>> arguments;
-    if (!check(TokenType::RIGHT_PAREN)) {
-        do {
-            if (arguments.size() >= 255) {
-                throw std::runtime_error("Cannot have more than 255 arguments.");
-            }
-            arguments.push_back(expression());
-        } while (match(TokenType::COMMA));
-    }
-
+// Closes a call whose arguments are all on exprScratch.
+Expr* Parser::finishCall(const ExprFrame& frame) {
     if (!match(TokenType::RIGHT_PAREN)) {
         throw std::runtime_error("Expected ')' after arguments.");
     }
 
-    auto* varExpr = dynamic_cast<VariableExpr*>(callee.get());
-    if (!varExpr) {
+    if (frame.left->kind != ExprKind::Variable) {
         throw std::runtime_error("Expected function name for call expression.");
     }
-    return std::make_unique<CallExpr>(varExpr->name, std::move(arguments));
-} 
\ No newline at end of file
+    auto varExpr = static_cast<VariableExpr*>(frame.left);
+    return arena.make<CallExpr>(varExpr->name, varExpr->symbol, takeList(exprScratch, frame.base));
+}
@@ -0,0 +1,189 @@
+#include "../include/resolver.h"
+#include <stdexcept>
+#include <string>
+
+Resolver::Resolver() : interner(Interner::shared()) {}
+
+void Resolver::resolve(Stmt* stmt) {
+    tasks.push_back({Task::VisitStmt, stmt});
+    run();
+}
+
+void Resolver::resolveBody(FunctionStmt* function) {
+    beginFunction(function);
+    run();
+}
+
+void Resolver::run() {
+    while (!tasks.empty()) {
+        Task task = tasks.back();
+        tasks.pop_back();
+        switch (task.kind) {
+            case Task::VisitStmt: visitStmt(task.stmt); break;
+            case Task::VisitExpr: visitExpr(task.expr); break;
+            case Task::Declare: {
+                auto varStmt = static_cast<VarStmt*>(task.stmt);
+                varStmt->slot = declare(varStmt->symbol, true);
+                bindings[varStmt->symbol].constant = varStmt->constant;
+                break;
+            }
+            case Task::EndScope:
+                while (shadowed.size() > task.mark) {
+                    bindings[shadowed.back().first] = shadowed.back().second;
+                    shadowed.pop_back();
+                }
+                nextSlot = task.slot;
+                function = task.function;
+                openScopes--;
+                break;
+        }
+    }
+}
+
+// Children are pushed last so they run first, and in source order.
+void Resolver::visitStmt(Stmt* stmt) {
+    auto expr = [this](Expr* e) { if (e) tasks.push_back({Task::VisitExpr, nullptr, e}); };
+    auto statement = [this](Stmt* s) { if (s) tasks.push_back({Task::VisitStmt, s}); };
+
+    switch (stmt->kind) {
+        case StmtKind::Expression: {
+            auto exprStmt = static_cast<ExprStmt*>(stmt);
+            expr(exprStmt->expression);
+            break;
+        }
+        case StmtKind::Print: {
+            auto printStmt = static_cast<PrintStmt*>(stmt);
+            expr(printStmt->expression);
+            break;
+        }
+        case StmtKind::Var: {
+            auto varStmt = static_cast<VarStmt*>(stmt);
+            // The initializer still sees any outer binding of the name.
+            tasks.push_back({Task::Declare, stmt});
+            expr(varStmt->initializer);
+            break;
+        }
+        case StmtKind::Block: {
+            auto blockStmt = static_cast<BlockStmt*>(stmt);
+            openScope();
+            for (size_t i = blockStmt->statements.size(); i-- > 0;) statement(blockStmt->statements[i]);
+            break;
+        }
+        case StmtKind::If: {
+            auto ifStmt = static_cast<IfStmt*>(stmt);
+            statement(ifStmt->elseBranch);
+            statement(ifStmt->thenBranch);
+            expr(ifStmt->condition);
+            break;
+        }
+        case StmtKind::While: {
+            auto whileStmt = static_cast<WhileStmt*>(stmt);
+            statement(whileStmt->body);
+            expr(whileStmt->condition);
+            break;
+        }
+        case StmtKind::For: {
+            auto forStmt = static_cast<ForStmt*>(stmt);
+            // Lowered as init; while (cond) { body; inc; } with no scope of its own.
+            expr(forStmt->increment);
+            statement(forStmt->body);
+            expr(forStmt->condition);
+            statement(forStmt->initializer);
+            break;
+        }
+        case StmtKind::Function: {
+            auto funcStmt = static_cast<FunctionStmt*>(stmt);
+            if (!funcStmt->deferred) beginFunction(funcStmt);
+            break;
+        }
+        case StmtKind::Return: {
+            auto returnStmt = static_cast<ReturnStmt*>(stmt);
+            expr(returnStmt->value);
+            break;
+        }
+    }
+}
+
+void Resolver::visitExpr(Expr* expr) {
+    auto push = [this](Expr* e) { tasks.push_back({Task::VisitExpr, nullptr, e}); };
+
+    switch (expr->kind) {
+        case ExprKind::Binary: {
+            auto binary = static_cast<BinaryExpr*>(expr);
+            push(binary->right);
+            push(binary->left);
+            break;
+        }
+        case ExprKind::Unary: {
+            auto unary = static_cast<UnaryExpr*>(expr);
+            push(unary->right);
+            break;
+        }
+        case ExprKind::Variable: {
+            auto variable = static_cast<VariableExpr*>(expr);
+            variable->slot = lookup(variable->symbol);
+            break;
+        }
+        case ExprKind::Assign: {
+            auto assign = static_cast<AssignExpr*>(expr);
+            assign->slot = lookup(assign->symbol);
+            if (bindings[assign->symbol].constant) {
+                throw std::runtime_error("Cannot assign to const " + std::string(interner.name(assign->symbol)));
+            }
+            push(assign->value);
+            break;
+        }
+        case ExprKind::Call: {
+            auto call = static_cast<CallExpr*>(expr);
+            for (size_t i = call->arguments.size(); i-- > 0;) push(call->arguments[i]);
+            break;
+        }
+        case ExprKind::Grouping: {
+            auto grouping = static_cast<GroupingExpr*>(expr);
+            push(grouping->expression);
+            break;
+        }
+        case ExprKind::Literal:
+            break;
+    }
+}
+
+// Queues the EndScope that undoes everything declared from here on.
+void Resolver::openScope() {
+    Task end{Task::EndScope};
+    end.mark = shadowed.size();
+    end.slot = nextSlot;
+    end.function = function;
+    tasks.push_back(end);
+    openScopes++;
+}
+
+// Parameters take the first slots, in order, so the code generator can
+// store argument i in slot i.
+void Resolver::beginFunction(FunctionStmt* stmt) {
+    openScope();
+    function = ++functionCount;
+    nextSlot = 0;
+    for (Symbol param : stmt->paramSymbols) declare(param, false);
+    for (size_t i = stmt->body.size(); i-- > 0;) tasks.push_back({Task::VisitStmt, stmt->body[i]});
+}
+
+uint32_t Resolver::declare(Symbol symbol, bool reuse) {
+    if (symbol >= bindings.size()) bindings.resize(interner.size());
+    Binding& binding = bindings[symbol];
+    // Bindings of closed scopes have been put back, so a live one at this
+    // depth belongs to the current scope.
+    if (reuse && binding.slot != NoSlot && binding.function == function && binding.depth == openScopes) {
+        return binding.slot;
+    }
+    if (openScopes > 0) shadowed.emplace_back(symbol, binding);
+    binding = {nextSlot++, function, openScopes};
+    return binding.slot;
+}
+
+uint32_t Resolver::lookup(Symbol symbol) const {
+    if (symbol >= bindings.size() || bindings[symbol].slot == NoSlot || bindings[symbol].function != function) {
+        throw std::runtime_error("Undefined variable: " + std::string(interner.name(symbol)));
+    }
+    return bindings[symbol].slot;
+}
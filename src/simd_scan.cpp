@@ -0,0 +1,267 @@
+#include "../include/simd_scan.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GRAN_SIMD_X86 1
+#endif
+
+namespace {
+
+inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// ---- Scalar -----------------------------------------------------------------
+
+size_t skipBlanksScalar(const char* data, size_t pos, size_t end, size_t& line, size_t& lineStart) {
+    while (pos < end && isBlank(data[pos])) {
+        if (data[pos] == '\n') {
+            line++;
+            lineStart = pos + 1;
+        }
+        pos++;
+    }
+    return pos;
+}
+
+size_t findNewlineScalar(const char* data, size_t pos, size_t end) {
+    if (pos >= end) return end;
+    const void* hit = std::memchr(data + pos, '\n', end - pos);
+    return hit ? static_cast<size_t>(static_cast<const char*>(hit) - data) : end;
+}
+
+size_t findQuoteScalar(const char* data, size_t pos, size_t end, size_t& newlines, size_t& lastNewline) {
+    newlines = 0;
+    while (pos < end && data[pos] != '"') {
+        if (data[pos] == '\n') {
+            newlines++;
+            lastNewline = pos;
+        }
+        pos++;
+    }
+    return pos;
+}
+
+#ifdef GRAN_SIMD_X86
+
+// Folds the '\n' bits of one block (already limited to the bytes consumed)
+// into the line counters.
+template <typename Mask>
+inline void countNewlines(Mask nl, size_t base, size_t& count, size_t& last) {
+    if (nl) {
+        count += static_cast<size_t>(__builtin_popcountll(static_cast<uint64_t>(nl)));
+        last = base + (63 - static_cast<size_t>(__builtin_clzll(static_cast<uint64_t>(nl))));
+    }
+}
+
+template <typename Mask>
+inline Mask lowBits(size_t n) {
+    return static_cast<Mask>((uint64_t(1) << n) - 1);
+}
+
+// ---- SSE2 (16 bytes per step) -----------------------------------------------
+
+__attribute__((target("sse2")))
+size_t skipBlanksSSE2(const char* data, size_t pos, size_t end, size_t& line, size_t& lineStart) {
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    size_t lines = 0;
+    size_t last = 0;
+    while (pos + 16 <= end) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        __m128i nlv = _mm_cmpeq_epi8(v, lf);
+        __m128i blank = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)),
+                                     _mm_or_si128(_mm_cmpeq_epi8(v, cr), nlv));
+        uint32_t other = ~static_cast<uint32_t>(_mm_movemask_epi8(blank)) & 0xFFFFu;
+        uint32_t nl = static_cast<uint32_t>(_mm_movemask_epi8(nlv));
+        if (other) {
+            size_t idx = static_cast<size_t>(__builtin_ctz(other));
+            countNewlines(nl & lowBits<uint32_t>(idx), pos, lines, last);
+            pos += idx;
+            if (lines) { line += lines; lineStart = last + 1; }
+            return pos;
+        }
+        countNewlines(nl, pos, lines, last);
+        pos += 16;
+    }
+    if (lines) { line += lines; lineStart = last + 1; }
+    return skipBlanksScalar(data, pos, end, line, lineStart);
+}
+
+__attribute__((target("sse2")))
+size_t findNewlineSSE2(const char* data, size_t pos, size_t end) {
+    const __m128i lf = _mm_set1_epi8('\n');
+    while (pos + 16 <= end) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        uint32_t nl = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, lf)));
+        if (nl) return pos + static_cast<size_t>(__builtin_ctz(nl));
+        pos += 16;
+    }
+    return findNewlineScalar(data, pos, end);
+}
+
+__attribute__((target("sse2")))
+size_t findQuoteSSE2(const char* data, size_t pos, size_t end, size_t& newlines, size_t& lastNewline) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i lf = _mm_set1_epi8('\n');
+    size_t lines = 0;
+    while (pos + 16 <= end) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        uint32_t q = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)));
+        uint32_t nl = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, lf)));
+        if (q) {
+            size_t idx = static_cast<size_t>(__builtin_ctz(q));
+            countNewlines(nl & lowBits<uint32_t>(idx), pos, lines, lastNewline);
+            newlines = lines;
+            return pos + idx;
+        }
+        countNewlines(nl, pos, lines, lastNewline);
+        pos += 16;
+    }
+    size_t tailLines = 0;
+    pos = findQuoteScalar(data, pos, end, tailLines, lastNewline);
+    newlines = lines + tailLines;
+    return pos;
+}
+
+// ---- AVX2 (32 bytes per step) -----------------------------------------------
+
+__attribute__((target("avx2")))
+size_t skipBlanksAVX2(const char* data, size_t pos, size_t end, size_t& line, size_t& lineStart) {
+    const __m256i sp = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    size_t lines = 0;
+    size_t last = 0;
+    while (pos + 32 <= end) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        __m256i nlv = _mm256_cmpeq_epi8(v, lf);
+        __m256i blank = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, tab)),
+                                        _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), nlv));
+        uint32_t other = ~static_cast<uint32_t>(_mm256_movemask_epi8(blank));
+        uint32_t nl = static_cast<uint32_t>(_mm256_movemask_epi8(nlv));
+        if (other) {
+            size_t idx = static_cast<size_t>(__builtin_ctz(other));
+            countNewlines(static_cast<uint64_t>(nl) & lowBits<uint64_t>(idx), pos, lines, last);
+            pos += idx;
+            if (lines) { line += lines; lineStart = last + 1; }
+            return pos;
+        }
+        countNewlines(nl, pos, lines, last);
+        pos += 32;
+    }
+    if (lines) { line += lines; lineStart = last + 1; }
+    return skipBlanksSSE2(data, pos, end, line, lineStart);
+}
+
+__attribute__((target("avx2")))
+size_t findNewlineAVX2(const char* data, size_t pos, size_t end) {
+    const __m256i lf = _mm256_set1_epi8('\n');
+    while (pos + 32 <= end) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        uint32_t nl = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, lf)));
+        if (nl) return pos + static_cast<size_t>(__builtin_ctz(nl));
+        pos += 32;
+    }
+    return findNewlineSSE2(data, pos, end);
+}
+
+__attribute__((target("avx2")))
+size_t findQuoteAVX2(const char* data, size_t pos, size_t end, size_t& newlines, size_t& lastNewline) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    size_t lines = 0;
+    while (pos + 32 <= end) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        uint32_t q = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)));
+        uint32_t nl = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, lf)));
+        if (q) {
+            size_t idx = static_cast<size_t>(__builtin_ctz(q));
+            countNewlines(static_cast<uint64_t>(nl) & lowBits<uint64_t>(idx), pos, lines, lastNewline);
+            newlines = lines;
+            return pos + idx;
+        }
+        countNewlines(nl, pos, lines, lastNewline);
+        pos += 32;
+    }
+    size_t tailLines = 0;
+    pos = findQuoteSSE2(data, pos, end, tailLines, lastNewline);
+    newlines = lines + tailLines;
+    return pos;
+}
+
+#endif // GRAN_SIMD_X86
+
+struct Kernels {
+    const char* name;
+    size_t (*skipBlanks)(const char*, size_t, size_t, size_t&, size_t&);
+    size_t (*findNewline)(const char*, size_t, size_t);
+    size_t (*findQuote)(const char*, size_t, size_t, size_t&, size_t&);
+};
+
+// A forced version the CPU (or this build) lacks falls back to the best one
+// available, with a warning, so a benchmark run never measures other kernels
+// than it reports without saying so.
+Kernels selectKernels() {
+    const Kernels scalar = {"scalar", skipBlanksScalar, findNewlineScalar, findQuoteScalar};
+    Kernels best = scalar;
+    [[maybe_unused]] bool hasSSE2 = false;
+    [[maybe_unused]] bool hasAVX2 = false;
+#ifdef GRAN_SIMD_X86
+    const Kernels sse2 = {"sse2", skipBlanksSSE2, findNewlineSSE2, findQuoteSSE2};
+    const Kernels avx2 = {"avx2", skipBlanksAVX2, findNewlineAVX2, findQuoteAVX2};
+    __builtin_cpu_init();
+    hasSSE2 = __builtin_cpu_supports("sse2");
+    hasAVX2 = __builtin_cpu_supports("avx2");
+    if (hasSSE2) best = sse2;
+    if (hasAVX2) best = avx2;
+#endif
+
+    const char* forced = std::getenv("GRAN_SIMD");
+    if (!forced || !*forced) return best;
+    if (std::strcmp(forced, "scalar") == 0) return scalar;
+#ifdef GRAN_SIMD_X86
+    if (std::strcmp(forced, "sse2") == 0 && hasSSE2) return sse2;
+    if (std::strcmp(forced, "avx2") == 0 && hasAVX2) return avx2;
+#endif
+    if (std::strcmp(forced, "sse2") == 0 || std::strcmp(forced, "avx2") == 0) {
+        std::fprintf(stderr, "GRAN_SIMD=%s is not supported here; using %s\n", forced, best.name);
+    } else {
+        std::fprintf(stderr, "GRAN_SIMD=%s is not scalar, sse2 or avx2; using %s\n", forced, best.name);
+    }
+    return best;
+}
+
+const Kernels& kernels() {
+    static const Kernels selected = selectKernels();
+    return selected;
+}
+
+} // namespace
+
+namespace simd_scan {
+
+size_t skipBlanks(const char* data, size_t pos, size_t end, size_t& line, size_t& lineStart) {
+    return kernels().skipBlanks(data, pos, end, line, lineStart);
+}
+
+size_t findNewline(const char* data, size_t pos, size_t end) {
+    return kernels().findNewline(data, pos, end);
+}
+
+size_t findQuote(const char* data, size_t pos, size_t end, size_t& newlines, size_t& lastNewline) {
+    return kernels().findQuote(data, pos, end, newlines, lastNewline);
+}
+
+const char* implementation() {
+    return kernels().name;
+}
+
+} // namespace simd_scan
@@ -0,0 +1,111 @@
+#include "../include/source_buffer.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iterator>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SourceBuffer SourceBuffer::fromFile(const std::string& path) {
+    if (path == "-") {
+        return fromDescriptor(STDIN_FILENO);
+    }
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open file: " + path + ": " + std::strerror(errno));
+    }
+    try {
+        SourceBuffer buffer = fromDescriptor(fd);
+        ::close(fd);
+        return buffer;
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+}
+
+SourceBuffer SourceBuffer::fromDescriptor(int fd) {
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        throw std::runtime_error(std::string("Failed to stat source: ") + std::strerror(errno));
+    }
+
+    SourceBuffer buffer;
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* addr = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            // The lexer makes a single forward pass over the buffer.
+            ::madvise(addr, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+            buffer.data = static_cast<const char*>(addr);
+            buffer.size = static_cast<size_t>(st.st_size);
+            buffer.mapped = true;
+            return buffer;
+        }
+        // Fall through and read it like a stream (e.g. filesystems without mmap).
+    }
+
+    char chunk[64 * 1024];
+    for (;;) {
+        ssize_t n = ::read(fd, chunk, sizeof(chunk));
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("Failed to read source: ") + std::strerror(errno));
+        }
+        buffer.owned.append(chunk, static_cast<size_t>(n));
+    }
+    buffer.data = buffer.owned.data();
+    buffer.size = buffer.owned.size();
+    return buffer;
+}
+
+SourceBuffer SourceBuffer::fromStream(std::istream& in) {
+    return fromString(std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>()));
+}
+
+SourceBuffer SourceBuffer::fromString(std::string text) {
+    SourceBuffer buffer;
+    buffer.owned = std::move(text);
+    buffer.data = buffer.owned.data();
+    buffer.size = buffer.owned.size();
+    return buffer;
+}
+
+SourceBuffer::SourceBuffer(SourceBuffer&& other) noexcept {
+    *this = std::move(other);
+}
+
+SourceBuffer& SourceBuffer::operator=(SourceBuffer&& other) noexcept {
+    if (this == &other) return *this;
+    release();
+    mapped = other.mapped;
+    size = other.size;
+    if (mapped) {
+        data = other.data;
+    } else {
+        // Moving the string may relocate small (SSO) contents.
+        owned = std::move(other.owned);
+        data = owned.data();
+    }
+    other.data = nullptr;
+    other.size = 0;
+    other.mapped = false;
+    other.owned.clear();
+    return *this;
+}
+
+SourceBuffer::~SourceBuffer() {
+    release();
+}
+
+void SourceBuffer::release() {
+    if (mapped) {
+        ::munmap(const_cast<char*>(data), size);
+    }
+    data = nullptr;
+    size = 0;
+    mapped = false;
+    owned.clear();
+}
@@ -2,7 +2,8 @@
 #include <sstream>
 #include <stdexcept>
 
-Transpiler::Transpiler(const std::vector<Token>& tokens) : tokens(tokens), current(0) {}
+Transpiler::Transpiler(const std::vector<Token>& tokens, std::string_view source)
+    : tokens(tokens), source(source), current(0) {}
 
 std::string Transpiler::transpile() {
     std::stringstream output;
@@ -51,16 +52,14 @@ bool Transpiler::match(TokenType type) {
 }
 
 std::string Transpiler::transpileStatement() {
-    if (match(TokenType::KEYWORD)) {
-        if (previous().value == "func") {
-            return transpileFunction();
-        } else if (previous().value == "print") {
-            return transpilePrint();
-        } else if (previous().value == "return") {
-            return transpileReturn();
-        } else if (previous().value == "var") {
-            return transpileVariable();
-        }
+    if (match(TokenType::KW_FUNC)) {
+        return transpileFunction();
+    } else if (match(TokenType::KW_SCREENIT)) {
+        return transpilePrint();
+    } else if (match(TokenType::KW_RETURN)) {
+        return transpileReturn();
+    } else if (match(TokenType::KW_VAR)) {
+        return transpileVariable();
     }
     
     throw std::runtime_error("Unexpected statement");
@@ -73,7 +72,7 @@ std::string Transpiler::transpileFunction() {
     if (!match(TokenType::IDENTIFIER)) {
         throw std::runtime_error("Expected function name");
     }
-    std::string funcName = previous().value;
+    std::string funcName(previous().text(source));
     
     // Parameters
     if (!match(TokenType::LEFT_PAREN)) {
@@ -110,9 +109,9 @@ std::string Transpiler::transpilePrint() {
     
     // Print argument
     if (match(TokenType::STRING_LITERAL)) {
-        output << "\"" << previous().value << "\"";
+        output << "\"" << previous().text(source) << "\"";
     } else if (match(TokenType::IDENTIFIER)) {
-        output << previous().value;
+        output << previous().text(source);
     } else {
         throw std::runtime_error("Expected string or identifier after print");
     }
@@ -143,9 +142,9 @@ std::string Transpiler::transpileVariable() {
     if (!match(TokenType::IDENTIFIER)) {
         throw std::runtime_error("Expected variable name");
     }
-    std::string varName = previous().value;
+    std::string varName(previous().text(source));
     
-    if (!match(TokenType::OPERATOR) || previous().value != "=") {
+    if (!match(TokenType::OPERATOR) || previous().text(source) != "=") {
         throw std::runtime_error("Expected '=' after variable name");
     }
     
@@ -153,11 +152,11 @@ std::string Transpiler::transpileVariable() {
     
     // Variable value
     if (match(TokenType::STRING_LITERAL)) {
-        output << "\"" << previous().value << "\"";
+        output << "\"" << previous().text(source) << "\"";
     } else if (match(TokenType::FLOAT_LITERAL)) {
-        output << previous().value;
+        output << previous().text(source);
     } else if (match(TokenType::IDENTIFIER)) {
-        output << previous().value;
+        output << previous().text(source);
     } else {
         throw std::runtime_error("Expected value after '='");
     }
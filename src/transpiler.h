@@ -2,15 +2,17 @@
 
 #include "lexer.h"
 #include <string>
+#include <string_view>
 #include <vector>
 
 class Transpiler {
 public:
-    explicit Transpiler(const std::vector<Token>& tokens);
+    Transpiler(const std::vector<Token>& tokens, std::string_view source);
     std::string transpile();
 
 private:
     std::vector<Token> tokens;
+    std::string_view source;
     size_t current;
 
     bool isAtEnd() const;
@@ -0,0 +1,429 @@
+#include "../include/type_inference.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+const char* typeName(ValueType type) {
+    switch (type) {
+        case ValueType::Unknown: return "unknown";
+        case ValueType::Int: return "int";
+        case ValueType::Double: return "double";
+        case ValueType::Bool: return "bool";
+        case ValueType::String: return "string";
+    }
+    return "unknown";
+}
+
+namespace {
+
+bool isNumber(ValueType type) { return type == ValueType::Int || type == ValueType::Double; }
+
+}  // namespace
+
+TypeInference::TypeInference(std::string_view source) : source(source), interner(Interner::shared()) {}
+
+void TypeInference::infer(const std::vector<Stmt*>& statements, const BodyLoader& loader, const Cloner& cloner) {
+    load = &loader;
+    clone = &cloner;
+    auto walk = [&] {
+        std::fill(functions.begin(), functions.end(), NoFunction);
+        slots.clear();
+        frame = 0;
+        function = NoFunction;
+        return round(statements.data(), statements.size());
+    };
+    while (walk()) {}
+    settling = true;
+    while (walk()) {}
+    settling = false;
+    load = nullptr;
+    clone = nullptr;
+    unsealed.clear();
+}
+
+void TypeInference::infer(Stmt* stmt) {
+    walked.clear();
+    while (round(&stmt, 1)) {}
+    settling = true;
+    while (round(&stmt, 1)) {}
+    settling = false;
+    seal();
+}
+
+bool TypeInference::round(Stmt* const* statements, size_t count) {
+    changed = false;
+    rounds++;
+    for (size_t i = count; i-- > 0;) tasks.push_back({Task::VisitStmt, statements[i]});
+    run();
+    return changed;
+}
+
+std::vector<uint32_t> TypeInference::specializations(uint32_t definition) const {
+    std::vector<uint32_t> used;
+    for (uint32_t index : signatures[definition].instances) {
+        if (signatures[index].round == rounds) used.push_back(index);
+    }
+    return used;
+}
+
+// Freezes what the last streamed statement typed: it is about to be lowered.
+void TypeInference::seal() {
+    for (uint32_t index : walked) signatures[index].sealed = true;
+    for (uint32_t index : unsealed) {
+        Slot& s = slots[index];
+        if (s.owner) s.type = *s.owner;
+        s.owner = nullptr;
+    }
+    unsealed.clear();
+}
+
+void TypeInference::run() {
+    while (!tasks.empty()) {
+        Task task = tasks.back();
+        tasks.pop_back();
+        switch (task.kind) {
+            case Task::VisitStmt: visitStmt(task.stmt); break;
+            case Task::VisitExpr: visitExpr(task.expr); break;
+            case Task::Declare: {
+                auto varStmt = static_cast<VarStmt*>(task.stmt);
+                if (varStmt->initializer) widen(varStmt->type, varStmt->initializer->type, false, varStmt->symbol);
+                if (settling && varStmt->type == ValueType::Unknown) {
+                    varStmt->type = ValueType::Int;
+                    changed = true;
+                }
+                slot(varStmt->slot) = {ValueType::Unknown, &varStmt->type};
+                if (frame == 0) unsealed.push_back(varStmt->slot);
+                break;
+            }
+            case Task::Return: {
+                auto returnStmt = static_cast<ReturnStmt*>(task.stmt);
+                if (function == NoFunction || !returnStmt->value) break;  // main always returns 0
+                Signature& sig = signatures[function];
+                widen(sig.result, returnStmt->value->type, sig.sealed, sig.name);
+                break;
+            }
+            case Task::EndFunction: {
+                Signature& sig = signatures[function];
+                if (settling && sig.result == ValueType::Unknown) {
+                    sig.result = ValueType::Int;
+                    changed = true;
+                }
+                slots.resize(frame);
+                frame = task.frame;
+                function = task.function;
+                break;
+            }
+            case Task::Binary: binary(static_cast<BinaryExpr*>(task.expr)); break;
+            case Task::Unary: {
+                auto unary = static_cast<UnaryExpr*>(task.expr);
+                ValueType operand = unary->right->type;
+                std::string_view op = unary->op.text(source);
+                bool ok = operand == ValueType::Unknown
+                    || (op == "-" && isNumber(operand))
+                    || (op == "!" && (operand == ValueType::Bool || isNumber(operand)));
+                if (!ok) {
+                    throw std::runtime_error("Operand of '" + std::string(op) + "' cannot be " + typeName(operand));
+                }
+                // `!` is logical, as in a condition: a number is true when non-zero
+                unary->type = op == "!" ? ValueType::Bool : operand;
+                break;
+            }
+            case Task::Call: call(static_cast<CallExpr*>(task.expr)); break;
+            case Task::Assign: {
+                auto assign = static_cast<AssignExpr*>(task.expr);
+                Slot& s = slot(assign->slot);
+                store(s, assign->value->type, assign->symbol);
+                assign->type = s.owner ? *s.owner : s.type;
+                break;
+            }
+            case Task::Grouping: {
+                auto grouping = static_cast<GroupingExpr*>(task.expr);
+                grouping->type = grouping->expression->type;
+                break;
+            }
+        }
+    }
+}
+
+// Children are pushed last so they run first, and in source order.
+void TypeInference::visitStmt(Stmt* stmt) {
+    auto expr = [this](Expr* e) { if (e) tasks.push_back({Task::VisitExpr, nullptr, e}); };
+    auto statement = [this](Stmt* s) { if (s) tasks.push_back({Task::VisitStmt, s}); };
+
+    switch (stmt->kind) {
+        case StmtKind::Expression: {
+            auto exprStmt = static_cast<ExprStmt*>(stmt);
+            expr(exprStmt->expression);
+            break;
+        }
+        case StmtKind::Print: {
+            auto printStmt = static_cast<PrintStmt*>(stmt);
+            expr(printStmt->expression);
+            break;
+        }
+        case StmtKind::Var: {
+            auto varStmt = static_cast<VarStmt*>(stmt);
+            tasks.push_back({Task::Declare, stmt});
+            expr(varStmt->initializer);
+            break;
+        }
+        case StmtKind::Block: {
+            auto blockStmt = static_cast<BlockStmt*>(stmt);
+            for (size_t i = blockStmt->statements.size(); i-- > 0;) statement(blockStmt->statements[i]);
+            break;
+        }
+        case StmtKind::If: {
+            auto ifStmt = static_cast<IfStmt*>(stmt);
+            statement(ifStmt->elseBranch);
+            statement(ifStmt->thenBranch);
+            expr(ifStmt->condition);
+            break;
+        }
+        case StmtKind::While: {
+            auto whileStmt = static_cast<WhileStmt*>(stmt);
+            statement(whileStmt->body);
+            expr(whileStmt->condition);
+            break;
+        }
+        case StmtKind::For: {
+            auto forStmt = static_cast<ForStmt*>(stmt);
+            expr(forStmt->increment);
+            statement(forStmt->body);
+            expr(forStmt->condition);
+            statement(forStmt->initializer);
+            break;
+        }
+        case StmtKind::Function: {
+            auto funcStmt = static_cast<FunctionStmt*>(stmt);
+            define(funcStmt);
+            break;
+        }
+        case StmtKind::Return: {
+            auto returnStmt = static_cast<ReturnStmt*>(stmt);
+            tasks.push_back({Task::Return, stmt});
+            expr(returnStmt->value);
+            break;
+        }
+    }
+}
+
+void TypeInference::visitExpr(Expr* expr) {
+    auto push = [this](Task::Kind kind, Expr* e) { tasks.push_back({kind, nullptr, e}); };
+
+    switch (expr->kind) {
+        case ExprKind::Binary: {
+            auto binary = static_cast<BinaryExpr*>(expr);
+            push(Task::Binary, expr);
+            push(Task::VisitExpr, binary->right);
+            push(Task::VisitExpr, binary->left);
+            break;
+        }
+        case ExprKind::Unary: {
+            auto unary = static_cast<UnaryExpr*>(expr);
+            push(Task::Unary, expr);
+            push(Task::VisitExpr, unary->right);
+            break;
+        }
+        case ExprKind::Literal: {
+            auto literal = static_cast<LiteralExpr*>(expr);
+            switch (literal->value.type) {
+                case TokenType::INT_LITERAL: literal->type = ValueType::Int; break;
+                case TokenType::FLOAT_LITERAL: literal->type = ValueType::Double; break;
+                case TokenType::BOOL_LITERAL: literal->type = ValueType::Bool; break;
+                case TokenType::STRING_LITERAL: literal->type = ValueType::String; break;
+                default: throw std::runtime_error("Unsupported literal: " + std::string(literal->value.text(source)));
+            }
+            break;
+        }
+        case ExprKind::Variable: {
+            auto variable = static_cast<VariableExpr*>(expr);
+            Slot& s = slot(variable->slot);
+            variable->type = s.owner ? *s.owner : s.type;
+            break;
+        }
+        case ExprKind::Assign: {
+            auto assign = static_cast<AssignExpr*>(expr);
+            push(Task::Assign, expr);
+            push(Task::VisitExpr, assign->value);
+            break;
+        }
+        case ExprKind::Call: {
+            auto call = static_cast<CallExpr*>(expr);
+            Signature& sig = signatures[lookup(call->symbol)];
+            if (call->arguments.size() != sig.params.size()) {
+                throw std::runtime_error("Expected " + std::to_string(sig.params.size()) + " arguments but got " +
+                                         std::to_string(call->arguments.size()) + " in call to " +
+                                         std::string(interner.name(call->symbol)));
+            }
+            if (sig.deferred) {
+                // Its body is walked from the next round on.
+                (*load)(sig.deferred);
+                sig.deferred = nullptr;
+                changed = true;
+            }
+            push(Task::Call, expr);
+            for (size_t i = call->arguments.size(); i-- > 0;) push(Task::VisitExpr, call->arguments[i]);
+            break;
+        }
+        case ExprKind::Grouping: {
+            auto grouping = static_cast<GroupingExpr*>(expr);
+            push(Task::Grouping, expr);
+            push(Task::VisitExpr, grouping->expression);
+            break;
+        }
+    }
+}
+
+// Registers the function under its name. Its body is walked when a call
+// reaches it.
+void TypeInference::define(FunctionStmt* stmt) {
+    if (stmt->signature == UINT32_MAX) {
+        stmt->signature = static_cast<uint32_t>(signatures.size());
+        Signature& sig = signatures.emplace_back();
+        sig.params.assign(stmt->params.size(), ValueType::Unknown);
+        sig.name = stmt->symbol;
+        sig.function = stmt;
+        sig.definition = stmt->signature;
+        if (stmt->deferred) sig.deferred = stmt;
+        if (!clone) sig.instances.push_back(stmt->signature);
+    }
+    if (stmt->symbol >= functions.size()) functions.resize(interner.size(), NoFunction);
+    if (functions[stmt->symbol] == NoFunction) functions[stmt->symbol] = stmt->signature;
+}
+
+// Queues a signature's body, once per round, with the parameters in the
+// first slots of a fresh frame as the Resolver numbered them.
+void TypeInference::walk(uint32_t index) {
+    Signature& sig = signatures[index];
+    if (sig.round == rounds) return;
+    if (!clone && sig.round == 0) walked.push_back(index);  // streamed: typed by this statement
+    sig.round = rounds;
+    Task end{Task::EndFunction, sig.function};
+    end.frame = frame;
+    end.function = function;
+    tasks.push_back(end);
+    frame = slots.size();
+    function = index;
+    for (uint32_t i = 0; i < sig.params.size(); i++) {
+        if (settling && sig.params[i] == ValueType::Unknown) {
+            sig.params[i] = ValueType::Int;
+            changed = true;
+        }
+        slot(i) = sig.sealed ? Slot{sig.params[i], nullptr} : Slot{ValueType::Unknown, &sig.params[i]};
+    }
+    ArenaList<Stmt*>& body = sig.function->body;
+    for (size_t i = body.size(); i-- > 0;) tasks.push_back({Task::VisitStmt, body[i]});
+}
+
+// Runs after the arguments are typed. When specializing, a call whose
+// argument types are all known picks (or makes) the signature for them and
+// has its body walked; until then it stays unknown, unless the program is
+// settling, when unknown arguments count as int. Streamed, the arguments
+// are joined into the function's one signature instead, and the first
+// statement that calls a function types its body along with itself.
+void TypeInference::call(CallExpr* expr) {
+    uint32_t definition = lookup(expr->symbol);
+    if (!clone) {
+        Signature& sig = signatures[definition];
+        for (size_t i = 0; i < expr->arguments.size(); i++) {
+            widen(sig.params[i], expr->arguments[i]->type, sig.sealed, sig.name);
+        }
+        expr->signature = definition;
+        expr->type = sig.result;
+        if (!sig.sealed) walk(definition);
+        return;
+    }
+
+    arguments.clear();
+    for (Expr* argument : expr->arguments) {
+        ValueType type = argument->type;
+        if (type == ValueType::Unknown && !settling) {
+            expr->signature = UINT32_MAX;
+            expr->type = ValueType::Unknown;
+            return;
+        }
+        arguments.push_back(type == ValueType::Unknown ? ValueType::Int : type);
+    }
+    uint32_t index = specialize(definition);
+    expr->signature = index;
+    expr->type = signatures[index].result;
+    walk(index);
+}
+
+// The first specialization of a function types the body as written; every
+// other one gets a copy of it.
+uint32_t TypeInference::specialize(uint32_t definition) {
+    for (uint32_t index : signatures[definition].instances) {
+        if (signatures[index].arguments == arguments) return index;
+    }
+    uint32_t index = definition;
+    if (!signatures[definition].instances.empty()) {
+        index = static_cast<uint32_t>(signatures.size());
+        FunctionStmt* copy = (*clone)(signatures[definition].function);
+        copy->signature = index;
+        Signature& sig = signatures.emplace_back();
+        sig.name = copy->symbol;
+        sig.function = copy;
+        sig.definition = definition;
+    }
+    Signature& sig = signatures[index];
+    sig.arguments = arguments;
+    sig.params = arguments;
+    signatures[definition].instances.push_back(index);
+    changed = true;
+    return index;
+}
+
+uint32_t TypeInference::lookup(Symbol symbol) const {
+    if (symbol >= functions.size() || functions[symbol] == NoFunction) {
+        throw std::runtime_error("Unknown function referenced: " + std::string(interner.name(symbol)));
+    }
+    return functions[symbol];
+}
+
+// Arithmetic takes numbers and yields double if either side is one;
+// comparisons yield bool, and == and != also compare bools.
+void TypeInference::binary(BinaryExpr* expr) {
+    ValueType left = expr->left->type;
+    ValueType right = expr->right->type;
+    std::string_view op = expr->op.text(source);
+    bool compare = expr->op.type == TokenType::COMPARE;
+    bool known = left != ValueType::Unknown && right != ValueType::Unknown;
+    if (known) {
+        bool ok = isNumber(left) && isNumber(right);
+        if (compare && (op == "==" || op == "!=")) ok = ok || (left == ValueType::Bool && right == ValueType::Bool);
+        if (!ok) {
+            throw std::runtime_error("Operands of '" + std::string(op) + "' cannot be " + typeName(left) +
+                                     " and " + typeName(right));
+        }
+    }
+    if (compare) {
+        expr->type = ValueType::Bool;
+    } else if (!known) {
+        expr->type = ValueType::Unknown;
+    } else {
+        expr->type = left == ValueType::Double || right == ValueType::Double ? ValueType::Double : ValueType::Int;
+    }
+}
+
+void TypeInference::store(Slot& s, ValueType type, Symbol name) {
+    if (s.owner) {
+        widen(*s.owner, type, false, name);
+    } else {
+        widen(s.type, type, true, name);
+    }
+}
+
+// Joins `type` into `target`. A sealed target has already been lowered, so
+// it only accepts values that fit as they are or that widen int to double.
+void TypeInference::widen(ValueType& target, ValueType type, bool sealed, Symbol name) {
+    if (type == ValueType::Unknown || type == target) return;
+    if (target == ValueType::Double && type == ValueType::Int) return;  // converted where it is stored
+    if (!sealed && (target == ValueType::Unknown || (target == ValueType::Int && type == ValueType::Double))) {
+        target = type;
+        changed = true;
+        return;
+    }
+    throw std::runtime_error("Type mismatch for " + std::string(interner.name(name)) + ": " + typeName(target) +
+                             " and " + typeName(type));
+}
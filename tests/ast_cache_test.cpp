@@ -0,0 +1,111 @@
+// AST cache checks: an entry loads back as the tree that was stored, an
+// entry with any single bit flipped is rejected rather than loaded as some
+// other program, and the directory stays under its size limit by dropping
+// the least recently used entries.
+
+#include <stdlib.h>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <vector>
+#include "../include/arena.h"
+#include "../include/ast_cache.h"
+#include "../include/lexer.h"
+#include "../include/parser.h"
+#include "check.h"
+
+namespace {
+
+const char* program =
+    "func fib(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }\n"
+    "var limit = 10;\n"
+    "for (var i = 0; i < limit; i = i + 1) { screenit fib(i) * 2 - -1; }\n"
+    "screenit \"done\";\n";
+
+std::string dump(const std::vector<Stmt*>& statements, std::string_view source) {
+    std::string text;
+    for (const Stmt* stmt : statements) text += stmt->toString(source) + "\n";
+    return text;
+}
+
+std::string readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+std::vector<Stmt*> parse(std::string_view source, Arena& arena) {
+    Lexer lexer(source);
+    Parser parser(lexer, source, arena);
+    return parser.parse();
+}
+
+void writeFile(const std::string& path, const std::string& bytes) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+}  // namespace
+
+int main() {
+    char directory[] = "/tmp/gran_cache_test.XXXXXX";
+    if (!mkdtemp(directory)) {
+        std::printf("FAIL mkdtemp\n");
+        return 1;
+    }
+    AstCache cache(directory);
+    std::string_view source = program;
+
+    Arena arena;
+    Lexer lexer(source);
+    Parser parser(lexer, source, arena);
+    std::vector<Stmt*> statements = parser.parse();
+    std::string expected = dump(statements, source);
+    expect(cache.store(source, statements), "store");
+
+    Arena loadArena;
+    std::optional<std::vector<Stmt*>> loaded = cache.load(source, loadArena);
+    expect(loaded && dump(*loaded, source) == expected, "round trip");
+
+    // Every single-bit corruption, of the header and of the payload
+    std::string path = cache.entryPath(source);
+    std::string entry = readFile(path);
+    size_t accepted = 0;
+    for (size_t bit = 0; bit < entry.size() * 8; bit++) {
+        std::string damaged = entry;
+        damaged[bit / 8] = static_cast<char>(damaged[bit / 8] ^ (1 << (bit % 8)));
+        writeFile(path, damaged);
+        Arena damagedArena;
+        if (cache.load(source, damagedArena)) accepted++;
+    }
+    expect(accepted == 0, std::to_string(accepted) + " corrupted entries loaded");
+
+    writeFile(path, entry);
+    Arena againArena;
+    expect(cache.load(source, againArena).has_value(), "intact entry loads again");
+
+    // Room for two entries: storing a third evicts the one used longest ago
+    std::string first = std::string(program) + "screenit 1;\n";
+    std::string second = std::string(program) + "screenit 2;\n";
+    std::string third = std::string(program) + "screenit 3;\n";
+    Arena limitArena;
+    cache.store(first, parse(first, limitArena));
+    uint64_t entryBytes = std::filesystem::file_size(cache.entryPath(first));
+    std::filesystem::remove(path);
+    AstCache limited(directory, entryBytes * 2 + entryBytes / 2);
+    limited.store(second, parse(second, limitArena));
+    auto past = std::filesystem::file_time_type::clock::now() - std::chrono::hours(1);
+    std::filesystem::last_write_time(limited.entryPath(first), past - std::chrono::minutes(1));
+    std::filesystem::last_write_time(limited.entryPath(second), past);
+    Arena hitArena;
+    expect(limited.load(first, hitArena).has_value(), "first entry loads before eviction");
+    limited.store(third, parse(third, limitArena));
+    expect(std::filesystem::exists(limited.entryPath(first)), "recently loaded entry kept");
+    expect(!std::filesystem::exists(limited.entryPath(second)), "least recently used entry evicted");
+    expect(std::filesystem::exists(limited.entryPath(third)), "new entry kept");
+
+    std::filesystem::remove_all(directory);
+    return report("ast_cache_test");
+}
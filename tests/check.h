@@ -0,0 +1,55 @@
+#pragma once
+// Helpers shared by the front-end checks in tests/, which `make check` builds
+// and runs. A check prints FAIL lines and exits non-zero if any expect() did
+// not hold.
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// A copy of `text` whose last byte is the last readable byte of a page, so
+// reading even one byte past the source (as mmap'd files of a page-size
+// multiple would allow) crashes instead of going unnoticed.
+class GuardedSource {
+public:
+    explicit GuardedSource(std::string_view text) {
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        length = (text.size() / page + 2) * page;
+        void* mapped = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED) throw std::runtime_error("mmap failed");
+        base = static_cast<char*>(mapped);
+        char* guard = base + length - page;
+        if (mprotect(guard, page, PROT_NONE) != 0) throw std::runtime_error("mprotect failed");
+        std::memcpy(guard - text.size(), text.data(), text.size());
+        source = std::string_view(guard - text.size(), text.size());
+    }
+    ~GuardedSource() { munmap(base, length); }
+    GuardedSource(const GuardedSource&) = delete;
+    GuardedSource& operator=(const GuardedSource&) = delete;
+
+    std::string_view source;
+
+private:
+    char* base = nullptr;
+    size_t length = 0;
+};
+
+inline int failures = 0;
+
+inline void expect(bool condition, const std::string& name) {
+    if (!condition) {
+        std::printf("FAIL %s\n", name.c_str());
+        failures++;
+    }
+}
+
+// Exit status of a check's main().
+inline int report(const char* check) {
+    if (failures) return 1;
+    std::printf("%s: ok\n", check);
+    return 0;
+}
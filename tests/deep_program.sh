@@ -0,0 +1,35 @@
+#!/bin/sh
+# End-to-end nesting check: compiles and runs a program whose blocks, if
+# statements, parentheses and unary minus chains nest 100000 levels deep, so
+# resolving, type inference, folding and IR generation all have to get
+# through it without recursing per level. Most of the run time is LLVM
+# compiling the resulting 50000 nested branches.
+#
+# Usage: tests/deep_program.sh [path/to/gran]
+
+set -e
+gran=${1:-./gran}
+program=$(mktemp)
+trap 'rm -f "$program"' EXIT
+
+awk -v depth=100000 'BEGIN {
+    print "var d = 0;"
+    for (i = 0; i < depth; i++) print (i % 2 ? "{" : "if (d < 1) {")
+    line = "d = "
+    for (i = 0; i < depth; i++) line = line "("
+    line = line "d + 41"
+    for (i = 0; i < depth; i++) line = line ")"
+    print line ";"
+    line = "screenit "
+    for (i = 0; i < depth; i++) line = line "- "
+    print line "d;"
+    for (i = 0; i < depth; i++) printf "}"
+    print ""
+}' > "$program"
+
+output=$(GRAN_CACHE=0 "$gran" "$program" 2>/dev/null)
+if [ "$output" != "41" ]; then
+    echo "FAIL deep_program: printed '$output', expected 41"
+    exit 1
+fi
+echo "deep_program: ok"
@@ -0,0 +1,116 @@
+// Lexer checks on random inputs built from pieces that stress the token
+// boundaries: string literals spanning lines, `//` comments with quotes in
+// them, operators that merge when adjacent, unknown characters and a string
+// left open at the end. scanTokens() is the reference for the parallel and
+// incremental paths.
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../include/lexer.h"
+#include "../include/thread_pool.h"
+#include "check.h"
+
+namespace {
+
+const char* const pieces[] = {
+    "func", "if", "else", "while", "for", "screenit", "return", "var", "const", "break", "true", "false",
+    "x", "fib", "a1", "_tmp", "0", "42", "3.14", "7.", "+", "-", "*", "/", "%", "=", "==", "!=", "!",
+    "<", "<=", ">", ">=", "(", ")", "{", "}", ";", ",", "@", "#", "\"\"", "\"text\"", "\"two\nlines\"",
+    "\"a // not a comment\"", "\"\n\n\"", "// note\n", "// \"quoted\n", "//\n", " ", "  ", "\t", "\n",
+    "\n\n", "\r\n",
+};
+
+std::string randomProgram(std::mt19937& random) {
+    std::string text;
+    size_t count = random() % 400;
+    for (size_t i = 0; i < count; i++) {
+        text += pieces[random() % std::size(pieces)];
+        if (random() % 3) text += random() % 4 ? " " : "\n";
+    }
+    if (random() % 8 == 0) text += "\"open to the end\n";
+    if (random() % 16 == 0) text += "var long = " + std::string(70000, '1') + ";\n";
+    return text;
+}
+
+bool sameTokens(const std::vector<Token>& a, const std::vector<Token>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].offset != b[i].offset || a[i].length != b[i].length || a[i].line != b[i].line ||
+            a[i].column != b[i].column || a[i].type != b[i].type) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Chunked lexing on a pool of several threads, with chunks down to one byte
+// so nearly every line boundary is a chunk boundary.
+void checkParallel(std::mt19937& random) {
+    ThreadPool pool(4);
+    for (int round = 0; round < 2000; round++) {
+        GuardedSource guarded(randomProgram(random));
+        std::vector<Token> expected = Lexer(guarded.source).scanTokens();
+        for (size_t minChunkBytes : {1, 2, 7, 64}) {
+            std::vector<Token> tokens = Lexer(guarded.source).scanTokensParallel(pool, minChunkBytes);
+            if (!sameTokens(tokens, expected)) {
+                expect(false, "scanTokensParallel(" + std::to_string(minChunkBytes) + ") on \"" +
+                                  std::string(guarded.source.substr(0, 200)) + "\"");
+                return;
+            }
+        }
+    }
+}
+
+const char* const insertions[] = {"", "\"", "//", "/", "\n", " ", "x", "1", "=", "==", "\"a\"", "// c\n", "\"\n"};
+
+// An offset where an edit is likely to change how much of the rest lexes:
+// inside or at the ends of a string literal, or at a `//` comment.
+size_t interestingOffset(std::mt19937& random, std::string_view text, const std::vector<Token>& tokens) {
+    if (random() % 2) {
+        for (int tries = 0; tries < 8; tries++) {
+            const Token& token = tokens[random() % tokens.size()];
+            if (token.type == TokenType::STRING_LITERAL) return token.offset + random() % (token.length + 2) - 1;
+        }
+    }
+    size_t comment = text.find("//", random() % (text.size() + 1));
+    return comment == std::string_view::npos ? random() % (text.size() + 1) : comment + random() % 3;
+}
+
+// Applies random edits one after another, relexing the same token array each
+// time, and compares it with a full scan of the edited text.
+void checkRelex(std::mt19937& random) {
+    for (int round = 0; round < 500; round++) {
+        std::string text = randomProgram(random);
+        std::vector<Token> tokens = Lexer(text).scanTokens();
+        for (int step = 0; step < 20; step++) {
+            size_t offset = random() % 4 ? interestingOffset(random, text, tokens) : random() % (text.size() + 1);
+            offset = std::min(offset, text.size());
+            size_t removed = std::min<size_t>(random() % 3 ? random() % 4 : random() % 64, text.size() - offset);
+            std::string inserted = random() % 4 ? insertions[random() % std::size(insertions)]
+                                                : pieces[random() % std::size(pieces)];
+            std::string before = text;
+            text.replace(offset, removed, inserted);
+
+            GuardedSource guarded(text);
+            Lexer(guarded.source).relex(tokens, {offset, removed, inserted.size()});
+            if (!sameTokens(tokens, Lexer(guarded.source).scanTokens())) {
+                expect(false, "relex of \"" + before.substr(0, 200) + "\" replacing " + std::to_string(removed) +
+                                  " bytes at " + std::to_string(offset) + " with \"" + inserted + "\"");
+                return;
+            }
+        }
+    }
+}
+
+}  // namespace
+
+int main() {
+    std::mt19937 random(6);
+    checkParallel(random);
+    checkRelex(random);
+    return report("lexer_test");
+}
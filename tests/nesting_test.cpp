@@ -0,0 +1,71 @@
+// Nesting checks: programs nested 100000 levels deep parse, flatten and
+// unflatten back to the same tree. Any pass that recursed once per level
+// would overflow the native stack here.
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../include/arena.h"
+#include "../include/flat_ast.h"
+#include "../include/lexer.h"
+#include "../include/parser.h"
+#include "check.h"
+
+namespace {
+
+constexpr size_t depth = 100000;
+
+std::string repeat(std::string_view piece, size_t count) {
+    std::string out;
+    out.reserve(piece.size() * count);
+    for (size_t i = 0; i < count; i++) out += piece;
+    return out;
+}
+
+std::string dump(const std::vector<Stmt*>& statements, std::string_view source) {
+    std::string text;
+    for (const Stmt* stmt : statements) text += stmt->toString(source) + "\n";
+    return text;
+}
+
+// Parses `text`, expecting the printed tree `expected`, then checks that
+// the flat form has one node per tree node and converts back unchanged.
+void check(const char* name, const std::string& text, const std::string& expected, size_t nodes) {
+    GuardedSource guarded(text);
+    Arena arena;
+    Lexer lexer(guarded.source);
+    Parser parser(lexer, guarded.source, arena);
+    std::vector<Stmt*> statements = parser.parse();
+    std::string printed = dump(statements, guarded.source);
+    expect(printed == expected, std::string(name) + ": parsed tree");
+
+    FlatAst flat = flatten(statements);
+    expect(flat.size() == nodes, std::string(name) + ": " + std::to_string(flat.size()) + " flat nodes");
+    Arena rebuiltArena;
+    std::vector<Stmt*> rebuilt = unflatten(flat.view(), guarded.source, rebuiltArena);
+    expect(dump(rebuilt, guarded.source) == expected, std::string(name) + ": unflattened tree");
+}
+
+}  // namespace
+
+int main() {
+    check("parentheses", "screenit " + repeat("(", depth) + "1" + repeat(")", depth) + ";",
+          "PrintStmt(" + repeat("GroupingExpr(", depth) + "LiteralExpr(1)" + repeat(")", depth) + ")\n",
+          depth + 2);
+
+    check("blocks", repeat("{", depth) + "screenit 1;" + repeat("}", depth),
+          repeat("BlockStmt([", depth) + "PrintStmt(LiteralExpr(1)), " + repeat("]), ", depth - 1) + "])\n",
+          depth + 2);
+
+    check("unary", "screenit " + repeat("-!", depth / 2) + "1;",
+          "PrintStmt(" + repeat("UnaryExpr(-, UnaryExpr(!, ", depth / 2) + "LiteralExpr(1)" +
+              repeat(")", depth) + ")\n",
+          depth + 2);
+
+    check("assignment", "var a;" + repeat("a = ", depth) + "1;",
+          "VarStmt(a, null)\nExprStmt(" + repeat("AssignExpr(a, ", depth) + "LiteralExpr(1)" +
+              repeat(")", depth) + ")\n",
+          depth + 3);
+
+    return report("nesting_test");
+}
@@ -0,0 +1,158 @@
+// Parser checks. Inputs are GuardedSources, so a read past the end of the
+// source crashes.
+
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../include/arena.h"
+#include "../include/lexer.h"
+#include "../include/parser.h"
+#include "../include/thread_pool.h"
+#include "check.h"
+
+namespace {
+
+// Parses the whole input; returns the number of statements, or -1 if it
+// was rejected.
+int parses(std::string_view text) {
+    GuardedSource guarded(text);
+    Arena arena;
+    Lexer lexer(guarded.source);
+    Parser parser(lexer, guarded.source, arena);
+    try {
+        return static_cast<int>(parser.parse().size());
+    } catch (const std::runtime_error&) {
+        return -1;
+    }
+}
+
+// Same, one statement at a time as --stream does.
+int streams(std::string_view text) {
+    GuardedSource guarded(text);
+    Arena arena;
+    Lexer lexer(guarded.source);
+    Parser parser(lexer, guarded.source, arena);
+    try {
+        int count = 0;
+        Stmt* stmt;
+        for (; parser.next(stmt); count++) arena.rewind();
+        return count;
+    } catch (const std::runtime_error&) {
+        return -1;
+    }
+}
+
+// Top-level pieces of random programs: mostly functions, so parseParallel
+// has places to cut, with a `func` inside braces that must not be cut at.
+const char* const declarations[] = {
+    "func add(a, b) { var t = a + b; if (t > 1) { return t; } return a * 2; }\n",
+    "func loop(n) { var i = 0; while (i < n) { i = i + 1; } return i; }\n",
+    "func none() { }\n",
+    "func lists(a) { for (var i = 0; i < a; i = i + 1) { screenit \"{ not a brace\"; } return a; }\n",
+    "{ func inner(x) { return x; } screenit inner(2); }\n",
+    "var v = 1 + 2 * 3;\n",
+    "screenit add(1, 2);\n",
+    "if (v == 7) { screenit \"seven\"; } else { screenit v; }\n",
+    "break;\n",
+};
+
+// Pieces with syntax errors, at the top level or inside a function body.
+const char* const mistakes[] = {
+    "var = ;\n",
+    "func (a) { }\n",
+    "func bad(a) { return a +; }\n",
+    "func open(a) { if (a { } }\n",
+    "screenit (1 + ;\n",
+    "}\n",
+    "{\n",
+    "func",
+};
+
+std::string randomProgram(std::mt19937& random, bool broken) {
+    std::string text;
+    size_t count = 1 + random() % 40;
+    size_t mistake = broken ? random() % count : count;
+    for (size_t i = 0; i < count; i++) {
+        text += i == mistake ? mistakes[random() % std::size(mistakes)]
+                             : declarations[random() % std::size(declarations)];
+    }
+    return text;
+}
+
+// The printed statements, or the error that ended the parse. In lazy mode
+// the deferred bodies are then parsed too, and their text or error added.
+std::string outcome(std::vector<Stmt*> (*parse)(const std::vector<Token>&, std::string_view, Arena&, bool),
+                    const std::vector<Token>& tokens, std::string_view source, bool lazy) {
+    Arena arena;
+    std::string text;
+    try {
+        std::vector<Stmt*> statements = parse(tokens, source, arena, lazy);
+        for (Stmt* stmt : statements) {
+            if (lazy && stmt && stmt->kind == StmtKind::Function) {
+                try {
+                    Parser::parseBody(static_cast<FunctionStmt*>(stmt), source, arena);
+                } catch (const std::runtime_error& error) {
+                    text += std::string("body error: ") + error.what() + "\n";
+                }
+            }
+            text += (stmt ? stmt->toString(source) : "null") + "\n";
+        }
+    } catch (const std::runtime_error& error) {
+        text += std::string("error: ") + error.what() + "\n";
+    }
+    return text;
+}
+
+std::vector<Stmt*> serial(const std::vector<Token>& tokens, std::string_view source, Arena& arena, bool lazy) {
+    Parser parser(tokens, source, arena);
+    parser.deferFunctionBodies(lazy);
+    return parser.parse();
+}
+
+// Cuts at every top-level `func` the pre-scan finds.
+std::vector<Stmt*> parallel(const std::vector<Token>& tokens, std::string_view source, Arena& arena, bool lazy) {
+    static ThreadPool pool(4);
+    return Parser::parseParallel(tokens, source, arena, pool, 1, lazy);
+}
+
+// parseParallel must give what parse() gives: the same trees, or the same
+// error, eagerly and lazily, for programs with and without mistakes.
+void checkParallel() {
+    std::mt19937 random(13);
+    for (int round = 0; round < 1000; round++) {
+        GuardedSource guarded(randomProgram(random, round % 2));
+        std::vector<Token> tokens = Lexer(guarded.source).scanTokens();
+        for (bool lazy : {false, true}) {
+            std::string expected = outcome(serial, tokens, guarded.source, lazy);
+            if (outcome(parallel, tokens, guarded.source, lazy) != expected) {
+                expect(false, std::string("parseParallel") + (lazy ? " (lazy)" : "") + " on \"" +
+                                  std::string(guarded.source) + "\"");
+                return;
+            }
+        }
+    }
+}
+
+}  // namespace
+
+int main() {
+    // Input ending inside an expression: the parser looks at END_OF_FILE
+    // for an infix operator, and must not read its (nonexistent) text. The
+    // unfinished statement is dropped quietly.
+    const char* unterminated[] = {"var x = 1 + 2", "screenit x", "x = y", "f(1", "var x = -", "screenit (1 < 2"};
+    for (const char* text : unterminated) {
+        expect(parses(text) == 0, text);
+        expect(streams(text) == 0, text);
+    }
+
+    expect(parses("var x = 1; var y = x + 2") == 1, "var x = 1; var y = x + 2");
+    expect(parses("var x = 1 + 2;") == 1, "var x = 1 + 2;");
+    expect(streams("func f(a) { return a * 2; } screenit f(3);") == 2, "func f(a) { return a * 2; } screenit f(3);");
+
+    checkParallel();
+
+    return report("parser_test");
+}
@@ -14,7 +14,7 @@ const TEMP_FILE = path.resolve(__dirname, 'temp.gran');
 app.post('/compile', (req, res) => {
     const code = req.body.code || '';
     fs.writeFileSync(TEMP_FILE, code);
-    exec(`${COMPILER_PATH} ${TEMP_FILE}`, { cwd: path.resolve(__dirname, '../../') }, (error, stdout, stderr) => {
+    exec(`${COMPILER_PATH} --tokens ${TEMP_FILE}`, { cwd: path.resolve(__dirname, '../../') }, (error, stdout, stderr) => {
         console.log('STDOUT:', stdout);
         console.log('STDERR:', stderr);
         if (error) {